@@ -0,0 +1,32 @@
+# Writes OUTPUT, a header holding the shaders and the default keymap from
+# RESOURCE_DIR as string constants, so the executable does not need the
+# resources directory.
+#   cmake -DRESOURCE_DIR=resources -DOUTPUT=embedded_resources.h -P embed_resources.cmake
+file(GLOB resources ${RESOURCE_DIR}/*.vert ${RESOURCE_DIR}/*.frag
+     ${RESOURCE_DIR}/*.cfg)
+list(SORT resources)
+
+set(text "//Generated from resources/ by cmake/embed_resources.cmake\n")
+string(APPEND text "#ifndef EMBEDDED_RESOURCES_H\n#define EMBEDDED_RESOURCES_H\n\n")
+string(APPEND text "#include <cstring>\n\n")
+string(APPEND text "struct embedded_resource {\n")
+string(APPEND text "  const char* name;  // file name in resources/\n")
+string(APPEND text "  const char* text;\n};\n\n")
+string(APPEND text "inline constexpr embedded_resource embedded_resources[] = {\n")
+foreach(resource ${resources})
+    get_filename_component(name ${resource} NAME)
+    file(READ ${resource} source)
+    string(FIND "${source}" ")chip8_resource\"" clash)
+    if(NOT clash EQUAL -1)
+        message(FATAL_ERROR "${name} contains the raw string delimiter")
+    endif()
+    string(APPEND text "    {\"${name}\", R\"chip8_resource(${source})chip8_resource\"},\n")
+endforeach()
+string(APPEND text "};\n\n")
+string(APPEND text "//Contents of resources/<name>, nullptr when it was not embedded\n")
+string(APPEND text "inline const char* embedded_resource_text(const char* name) {\n")
+string(APPEND text "  for (const embedded_resource& resource : embedded_resources) {\n")
+string(APPEND text "    if (std::strcmp(resource.name, name) == 0)\n")
+string(APPEND text "      return resource.text;\n")
+string(APPEND text "  }\n  return nullptr;\n}\n\n#endif\n")
+file(WRITE ${OUTPUT} "${text}")
@@ -0,0 +1,30 @@
+//libFuzzer target: every input is loaded as a ROM and run for a bounded
+//number of instructions. Build with -DCHIP8_BUILD_FUZZER=ON using clang, the
+//target is instrumented with ASan and UBSan so any out-of-bounds access in
+//the interpreter aborts the run.
+#include <cstddef>
+#include <cstdint>
+#include "chip8.h"
+
+namespace {
+
+constexpr int max_cycles = 20000;
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static chip8 machine;
+  machine.initialize();
+  //Keep CXNN reproducible between runs of the same input
+  machine.seed_random(0);
+  if (!machine.load_game(data, size))
+    return 0;
+  //Hold a few keys so EX9E/EXA1 take both paths and FX0A can finish
+  if (size > 0) {
+    machine.key_event(data[0] & 0xF, true);
+    machine.key_event(data[0] >> 4, false);
+  }
+  for (int i = 0; i < max_cycles; ++i)
+    machine.emulate_cycle();
+  return 0;
+}
@@ -1,8 +1,15 @@
 #version 330 core
 
+layout(std140) uniform frame_params
+{
+  vec4 foreground;
+  vec4 background;
+  vec4 scale;
+};
+
 out vec3 FragColor;
 
 void main()
 {
-  FragColor = vec3(0.5f,0.3f,0.0f);
+  FragColor = foreground.rgb;
 }
\ No newline at end of file
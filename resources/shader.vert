@@ -2,7 +2,14 @@
 
 layout(location=0) in vec3 aPos;
 
+layout(std140) uniform frame_params
+{
+    vec4 foreground;
+    vec4 background;
+    vec4 scale;
+};
+
 void main()
 {
-    gl_Position = vec4(aPos,1.0);
+    gl_Position = vec4(aPos.xy * scale.xy + scale.zw, 0.0, 1.0);
 }
\ No newline at end of file
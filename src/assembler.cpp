@@ -0,0 +1,225 @@
+#include "assembler.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include "disasm.h"
+
+namespace {
+
+struct statement {
+  int line;
+  std::string mnemonic;               // upper case
+  std::vector<std::string> operands;  // as written
+};
+
+std::string trim(const std::string& text) {
+  const std::size_t first = text.find_first_not_of(" \t\r");
+  if (first == std::string::npos)
+    return "";
+  return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+std::string upper(std::string text) {
+  for (char& c : text)
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  return text;
+}
+
+bool is_identifier(const std::string& text) {
+  if (text.empty() || std::isdigit(static_cast<unsigned char>(text[0])))
+    return false;
+  for (char c : text) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '.')
+      return false;
+  }
+  return true;
+}
+
+//Register number for V0-VF, -1 otherwise
+int register_of(const std::string& text) {
+  if (text.size() != 2 || std::toupper(static_cast<unsigned char>(text[0])) != 'V' ||
+      !std::isxdigit(static_cast<unsigned char>(text[1])))
+    return -1;
+  return static_cast<int>(std::strtol(text.c_str() + 1, nullptr, 16));
+}
+
+class assembler {
+ public:
+  assembler(uint16_t origin, std::string& error)
+      : m_origin(origin), m_error(error) {}
+
+  bool parse(const std::string& source);
+  bool emit(std::vector<unsigned char>& rom);
+
+ private:
+  bool fail(int line, const std::string& reason) {
+    m_error = "line " + std::to_string(line) + ": " + reason;
+    return false;
+  }
+  bool value(const statement& s, const std::string& text, unsigned limit,
+             unsigned& result);
+  bool encode(const statement& s, uint16_t& opcode);
+
+  uint16_t m_origin;
+  std::string& m_error;
+  std::vector<statement> m_statements;
+  std::map<std::string, unsigned> m_labels;
+};
+
+bool assembler::parse(const std::string& source) {
+  std::istringstream in(source);
+  std::string text;
+  unsigned address = m_origin;
+  for (int line = 1; std::getline(in, text); ++line) {
+    text = trim(text.substr(0, text.find(';')));
+    //Labels, possibly followed by an instruction on the same line
+    std::size_t colon;
+    while ((colon = text.find(':')) != std::string::npos) {
+      const std::string name = trim(text.substr(0, colon));
+      if (!is_identifier(name) || register_of(name) >= 0)
+        return fail(line, "bad label '" + name + "'");
+      if (!m_labels.emplace(name, address).second)
+        return fail(line, "label '" + name + "' defined twice");
+      text = trim(text.substr(colon + 1));
+    }
+    if (text.empty())
+      continue;
+
+    statement s{line, "", {}};
+    const std::size_t space = text.find_first_of(" \t");
+    s.mnemonic = upper(text.substr(0, space));
+    if (space != std::string::npos) {
+      std::istringstream operands(text.substr(space));
+      std::string operand;
+      while (std::getline(operands, operand, ','))
+        s.operands.push_back(trim(operand));
+    }
+    if (s.mnemonic == "DB")
+      address += s.operands.size();
+    else if (s.mnemonic == "DW")
+      address += 2 * s.operands.size();
+    else
+      address += 2;
+    if (address > 0x1000)
+      return fail(line, "program doesn't fit in memory");
+    m_statements.push_back(std::move(s));
+  }
+  return true;
+}
+
+bool assembler::value(const statement& s, const std::string& text,
+                      unsigned limit, unsigned& result) {
+  const auto label = m_labels.find(text);
+  if (label != m_labels.end()) {
+    result = label->second;
+  } else {
+    const char* digits = text.c_str();
+    int base = 10;
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+      digits += 2;
+      base = 16;
+    } else if (text.size() > 2 && text[0] == '0' &&
+               (text[1] == 'b' || text[1] == 'B')) {
+      digits += 2;
+      base = 2;
+    } else if (text.size() > 1 && text[0] == '$') {
+      digits += 1;
+      base = 16;
+    }
+    char* end = nullptr;
+    const unsigned long number = std::strtoul(digits, &end, base);
+    if (text.empty() || *digits == '\0' || *end != '\0')
+      return fail(s.line, "'" + text + "' is neither a number nor a label");
+    result = static_cast<unsigned>(number);
+  }
+  if (result > limit)
+    return fail(s.line, "'" + text + "' is out of range");
+  return true;
+}
+
+//Finds the table row whose mnemonic and operand pattern fit the statement
+bool assembler::encode(const statement& s, uint16_t& opcode) {
+  bool mnemonic_known = false;
+  for (std::size_t i = 0; i < instruction_table_size; ++i) {
+    const instruction_form& form = instruction_table[i];
+    if (s.mnemonic != form.mnemonic)
+      continue;
+    mnemonic_known = true;
+    std::vector<std::string> pattern;
+    std::istringstream operands(form.operands);
+    for (std::string p; std::getline(operands, p, ',');)
+      pattern.push_back(p);
+    if (pattern.size() != s.operands.size())
+      continue;
+
+    uint16_t result = form.match;
+    bool fits = true;
+    for (std::size_t k = 0; k < pattern.size() && fits; ++k) {
+      const std::string& p = pattern[k];
+      const std::string& operand = s.operands[k];
+      const int reg = register_of(operand);
+      if (p == "x" || p == "y") {
+        fits = reg >= 0;
+        result |= (reg & 0xF) << (p == "x" ? 8 : 4);
+      } else if (p == "n" || p == "nn" || p == "nnn") {
+        if (reg >= 0 || upper(operand) == "I" || upper(operand) == "[I]" ||
+            upper(operand) == "DT" || upper(operand) == "ST" ||
+            upper(operand) == "K" || upper(operand) == "F" ||
+            upper(operand) == "B") {
+          fits = false;
+          break;
+        }
+        unsigned number;
+        if (!value(s, operand, (1u << (4 * p.size())) - 1, number))
+          return false;
+        result |= number;
+      } else {
+        fits = upper(operand) == p;
+      }
+    }
+    if (fits) {
+      opcode = result;
+      return true;
+    }
+  }
+  if (!mnemonic_known)
+    return fail(s.line, "unknown instruction '" + s.mnemonic + "'");
+  return fail(s.line, "operands don't fit any form of " + s.mnemonic);
+}
+
+bool assembler::emit(std::vector<unsigned char>& rom) {
+  std::vector<unsigned char> bytes;
+  for (const statement& s : m_statements) {
+    if (s.mnemonic == "DB" || s.mnemonic == "DW") {
+      const bool words = s.mnemonic == "DW";
+      if (s.operands.empty())
+        return fail(s.line, s.mnemonic + " without values");
+      for (const std::string& operand : s.operands) {
+        unsigned number;
+        if (!value(s, operand, words ? 0xFFFF : 0xFF, number))
+          return false;
+        if (words)
+          bytes.push_back(static_cast<unsigned char>(number >> 8));
+        bytes.push_back(static_cast<unsigned char>(number & 0xFF));
+      }
+      continue;
+    }
+    uint16_t opcode;
+    if (!encode(s, opcode))
+      return false;
+    bytes.push_back(static_cast<unsigned char>(opcode >> 8));
+    bytes.push_back(static_cast<unsigned char>(opcode & 0xFF));
+  }
+  rom.swap(bytes);
+  return true;
+}
+
+}  // namespace
+
+bool assemble(const std::string& source, std::vector<unsigned char>& rom,
+              std::string& error, uint16_t origin) {
+  assembler a(origin, error);
+  return a.parse(source) && a.emit(rom);
+}
@@ -0,0 +1,16 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Assembles the mnemonics disassemble() prints, one instruction per line.
+//Also understands "name:" labels, usable wherever an address is expected,
+//DB and DW data lists and ';' comments. Numbers are decimal, 0x or $ hex, or
+//0b binary. The first byte is placed at origin. On failure error holds the
+//line number and the reason and rom is left unchanged.
+bool assemble(const std::string& source, std::vector<unsigned char>& rom,
+              std::string& error, uint16_t origin = 0x200);
+
+#endif
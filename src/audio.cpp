@@ -0,0 +1,201 @@
+#include "audio.h"
+#include <chrono>
+
+namespace {
+
+constexpr uint32_t tone_hz = 440;
+constexpr int16_t amplitude = 4000;
+constexpr uint32_t phase_step = tone_hz * 65536 / audio::sample_rate;
+constexpr int64_t frame_samples =
+    int64_t{audio::sample_rate} * chip8::frame_time / 1000000;
+
+uint64_t steady_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+audio::audio() {
+  m_events.reserve(64);
+}
+
+audio::~audio() {
+  stop();
+}
+
+bool audio::start(std::unique_ptr<audio_sink> sink) {
+  stop();
+  m_start = steady_ns();
+  m_rendered = 0;
+  m_mapped = false;
+  m_events.clear();
+  m_sink = std::move(sink);
+  return m_sink && m_sink->start(*this);
+}
+
+void audio::stop() {
+  if (m_sink) {
+    m_sink->stop();
+    m_sink.reset();
+  }
+}
+
+uint64_t audio::now_sample() const {
+  return (steady_ns() - m_start) * sample_rate / 1000000000;
+}
+
+void audio::sound_edge(unsigned long long time, bool on) {
+  if (!m_sink)
+    return;
+  const int64_t emulated =
+      static_cast<int64_t>(time * sample_rate / 1000000);
+  const int64_t now = static_cast<int64_t>(now_sample());
+  int64_t sample = m_offset + emulated;
+  //First edge, or emulation fell behind (debugger, stall) or got too far
+  //ahead of the ring: map this edge one frame from now, later edges keep
+  //their spacing from it
+  if (!m_mapped || sample < static_cast<int64_t>(m_rendered) ||
+      sample > now + static_cast<int64_t>(ring_size / 2)) {
+    m_offset = now + frame_samples - emulated;
+    m_mapped = true;
+    sample = now + frame_samples;
+  }
+  //Edges stay in order even when the mapping moved back
+  if (!m_events.empty() &&
+      sample < static_cast<int64_t>(m_events.back().sample))
+    sample = static_cast<int64_t>(m_events.back().sample);
+  m_events.push_back({static_cast<uint64_t>(sample), on});
+}
+
+void audio::update() {
+  if (!m_sink)
+    return;
+  const uint64_t target = now_sample();
+  std::size_t next_event = 0;
+  int16_t block[512];
+  while (m_rendered < target) {
+    //Apply every edge that starts at the current sample
+    while (next_event < m_events.size() &&
+           m_events[next_event].sample <= m_rendered) {
+      m_tone = m_events[next_event].on;
+      ++next_event;
+    }
+    uint64_t end = target;
+    if (next_event < m_events.size() && m_events[next_event].sample < end)
+      end = m_events[next_event].sample;
+    if (end - m_rendered > sizeof(block) / sizeof(block[0]))
+      end = m_rendered + sizeof(block) / sizeof(block[0]);
+
+    const std::size_t count = end - m_rendered;
+    for (std::size_t i = 0; i < count; ++i) {
+      if (m_tone) {
+        block[i] = (m_phase & 0x8000) ? amplitude : -amplitude;
+        m_phase += phase_step;
+      } else {
+        block[i] = 0;
+      }
+    }
+    //A stalled sink drops samples instead of shifting the edges in time
+    m_ring.push(block, count);
+    m_rendered = end;
+  }
+  m_events.erase(m_events.begin(), m_events.begin() + next_event);
+}
+
+void audio::read(int16_t* out, std::size_t count) {
+  const std::size_t got = m_ring.pop(out, count);
+  if (got < count) {
+    for (std::size_t i = got; i < count; ++i)
+      out[i] = 0;
+    m_underruns.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool null_sink::start(audio& engine) {
+  stop();
+  m_running = true;
+  m_thread = std::thread([this, &engine] {
+    int16_t block[audio::sample_rate / 50];
+    const auto begin = std::chrono::steady_clock::now();
+    uint64_t pulled = 0;
+    //Keep half the ring as latency so the producer can stay behind real time
+    const uint64_t latency = audio::ring_size / 2;
+    while (m_running) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      const auto elapsed = std::chrono::steady_clock::now() - begin;
+      const uint64_t due =
+          std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+                  .count() *
+              audio::sample_rate / 1000000;
+      while (due > pulled + latency) {
+        std::size_t count = sizeof(block) / sizeof(block[0]);
+        if (due - pulled - latency < count)
+          count = due - pulled - latency;
+        engine.read(block, count);
+        consume(block, count);
+        pulled += count;
+      }
+    }
+  });
+  return true;
+}
+
+void null_sink::stop() {
+  m_running = false;
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+wav_sink::~wav_sink() {
+  stop();
+  if (m_file) {
+    write_header();
+    std::fclose(m_file);
+  }
+}
+
+bool wav_sink::start(audio& engine) {
+  m_file = std::fopen(m_file_name.c_str(), "wb");
+  if (!m_file)
+    return false;
+  write_header();
+  return null_sink::start(engine);
+}
+
+void wav_sink::consume(const int16_t* samples, std::size_t count) {
+  std::fwrite(samples, sizeof(int16_t), count, m_file);
+  m_samples += static_cast<uint32_t>(count);
+}
+
+//RIFF header for 16-bit mono PCM, rewritten with the final sizes on close
+void wav_sink::write_header() {
+  auto put32 = [this](uint32_t v) {
+    unsigned char b[4] = {static_cast<unsigned char>(v),
+                          static_cast<unsigned char>(v >> 8),
+                          static_cast<unsigned char>(v >> 16),
+                          static_cast<unsigned char>(v >> 24)};
+    std::fwrite(b, 1, 4, m_file);
+  };
+  auto put16 = [this](uint16_t v) {
+    unsigned char b[2] = {static_cast<unsigned char>(v),
+                          static_cast<unsigned char>(v >> 8)};
+    std::fwrite(b, 1, 2, m_file);
+  };
+  const uint32_t data_size = m_samples * 2;
+  std::fseek(m_file, 0, SEEK_SET);
+  std::fwrite("RIFF", 1, 4, m_file);
+  put32(36 + data_size);
+  std::fwrite("WAVEfmt ", 1, 8, m_file);
+  put32(16);                     // fmt chunk size
+  put16(1);                      // PCM
+  put16(1);                      // mono
+  put32(audio::sample_rate);     // sample rate
+  put32(audio::sample_rate * 2); // byte rate
+  put16(2);                      // block align
+  put16(16);                     // bits per sample
+  std::fwrite("data", 1, 4, m_file);
+  put32(data_size);
+  std::fseek(m_file, 0, SEEK_END);
+}
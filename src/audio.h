@@ -0,0 +1,107 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+#include "spsc_queue.h"
+
+class audio;
+
+//Something that plays (or stores) the samples produced by the audio engine.
+//A sink pulls samples from its own thread through audio::read(), which acts
+//as the audio callback.
+class audio_sink {
+ public:
+  virtual ~audio_sink() = default;
+  virtual bool start(audio& engine) = 0;
+  virtual void stop() = 0;
+};
+
+//Beeper synthesis. The machine reports sound timer on/off edges stamped
+//with emulated time, each is placed on the sample that time maps to, and
+//update() renders the square wave up to the present into a lock-free ring.
+//Edges keep their emulated spacing even when several frames run in one
+//batch, down to a one-frame beep. Emulated time is mapped one frame behind
+//real time and the mapping is moved when emulation stalls or races ahead.
+class audio : public sound_listener {
+ public:
+  static constexpr int sample_rate = 44100;
+  static constexpr std::size_t ring_size = 8192;  // samples, ~185 ms
+
+  audio();
+  ~audio();
+  bool start(std::unique_ptr<audio_sink> sink);
+  void stop();
+
+  //Producer side (emulation thread)
+  void sound_edge(unsigned long long time, bool on) override;
+  void update();
+
+  //Consumer side (sink thread). Missing samples are filled with silence.
+  void read(int16_t* out, std::size_t count);
+
+  std::size_t buffered() const { return m_ring.size(); }
+  uint64_t underruns() const { return m_underruns.load(); }
+
+ private:
+  struct tone_event {
+    uint64_t sample;
+    bool on;
+  };
+
+  uint64_t now_sample() const;
+
+  spsc_queue<int16_t, ring_size> m_ring;
+  std::vector<tone_event> m_events;  // producer only
+  std::unique_ptr<audio_sink> m_sink;
+  uint64_t m_start = 0;     // steady clock ns of sample 0
+  uint64_t m_rendered = 0;  // next sample to render
+  int64_t m_offset = 0;     // sample of emulated time 0
+  bool m_mapped = false;    // m_offset is set
+  uint32_t m_phase = 0;     // square wave phase, 16.16 fixed point
+  bool m_tone = false;
+  std::atomic<uint64_t> m_underruns{0};
+};
+
+//Discards samples at the real-time rate, for headless runs.
+class null_sink : public audio_sink {
+ public:
+  ~null_sink() override { stop(); }
+  bool start(audio& engine) override;
+  void stop() override;
+
+ protected:
+  //Called with every block pulled from the engine.
+  virtual void consume(const int16_t*, std::size_t) {}
+
+ private:
+  std::thread m_thread;
+  std::atomic<bool> m_running{false};
+};
+
+//Writes the output to a 16-bit mono WAV file.
+class wav_sink : public null_sink {
+ public:
+  explicit wav_sink(std::string file_name) : m_file_name(file_name) {}
+  ~wav_sink() override;
+  bool start(audio& engine) override;
+
+ protected:
+  void consume(const int16_t* samples, std::size_t count) override;
+
+ private:
+  void write_header();
+
+  std::string m_file_name;
+  std::FILE* m_file = nullptr;
+  uint32_t m_samples = 0;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef BREAKPOINTS_H
+#define BREAKPOINTS_H
+
+#include <cstdint>
+
+//PC and memory-write breakpoints as one bit per address of the 4 KB address
+//space. Testing an address is a single load whatever the number of
+//breakpoints, so the interpreter can afford to check every instruction.
+class breakpoints {
+ public:
+  bool pc(unsigned address) const { return test(m_pc, address); }
+  bool write(unsigned address) const { return test(m_write, address); }
+  //Any watched address in [first, first + count), wrapping like the memory
+  bool write(unsigned first, unsigned count) const {
+    for (unsigned i = 0; i < count; ++i) {
+      if (test(m_write, first + i))
+        return true;
+    }
+    return false;
+  }
+
+  void toggle_pc(unsigned address) { flip(m_pc, address); }
+  void toggle_write(unsigned address) { flip(m_write, address); }
+  void clear() {
+    for (int i = 0; i < words; ++i)
+      m_pc[i] = m_write[i] = 0;
+  }
+
+ private:
+  static constexpr int words = 4096 / 64;
+
+  static bool test(const uint64_t* bits, unsigned address) {
+    address &= 0xFFF;
+    return bits[address >> 6] >> (address & 63) & 1;
+  }
+  static void flip(uint64_t* bits, unsigned address) {
+    address &= 0xFFF;
+    bits[address >> 6] ^= uint64_t(1) << (address & 63);
+  }
+
+  uint64_t m_pc[words] = {};
+  uint64_t m_write[words] = {};
+};
+
+#endif
@@ -3,8 +3,42 @@
 #include <ctime>
 #include <fstream>
 #include <ios>
-#include <iostream>
+#include <iterator>
 #include <string>
+#include <vector>
+#include "breakpoints.h"
+#include "compiled.h"
+#include "input.h"
+#include "jit.h"
+#include "log.h"
+#include "opcodes.h"
+#include "plugin_abi.h"
+#include "trace.h"
+
+namespace {
+
+//What each instruction costs on the COSMAC VIP, from the instruction table.
+//Unknown opcodes are charged like the cheapest instruction of their group so
+//a ROM stuck on one still runs out its frames.
+struct vip_costs {
+  uint16_t unknown[16];
+  constexpr vip_costs() : unknown() {
+    for (const instruction_form& form : instruction_table) {
+      uint16_t& cost = unknown[form.match >> 12];
+      if (!cost || form.vip_cost < cost)
+        cost = form.vip_cost;
+    }
+  }
+};
+constexpr vip_costs vip_cost_table{};
+
+int vip_cost(unsigned short opcode) {
+  if (const instruction_form* form = decode(opcode))
+    return form->vip_cost;
+  return vip_cost_table.unknown[opcode >> 12];
+}
+
+}  // namespace
 
 chip8::chip8() {
   //Nothing to be initialize
@@ -34,6 +68,12 @@ void chip8::initialize() {
   for (int i = 0; i < 16; ++i) {
     key[i] = V[i] = 0;
   }
+  key_released = 0;
+  key_wait = false;
+  cycles = 0;
+  budget = 0;
+  vblank_wait = false;
+  halted = skip_break = false;
 
   //clear memory
   for (int i = 0; i < 4096; i++) {
@@ -44,318 +84,429 @@ void chip8::initialize() {
   for (int i = 0; i < 80; ++i) {
     memory[i] = chip8_font[i];
   }
+  code_written(0, 4096);
 
-  //Reset Timers
+  //Reset Timers, a beep still playing stops here
   delay_timer = 0;
   sound_timer = 0;
+  sound_changed();
+  frames = 0;
+  frame_offset = 0;
 
   //Clear Screen once
   drawFlag = true;
 
-  srand(time(NULL));
+  seed_random(static_cast<unsigned>(time(NULL)));
+}
+
+void chip8::seed_random(unsigned seed) {
+  //xorshift32 must not start at 0
+  random_state = seed ^ 0x9E3779B9u;
+  if (random_state == 0)
+    random_state = 1;
+}
+
+//Each machine has its own generator so runs with the same seed repeat
+//exactly, whatever other machines in the process do
+unsigned char chip8::random_byte() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return static_cast<unsigned char>(random_state >> 24);
 }
 
 //Chip8 Opcode details
 //From: http://devernay.free.fr/hacks/chip8/C8TECH10.HTM This has a lot of good information
 void chip8::emulate_cycle() {
+  if (breaks) {
+    if (breaks->pc(PC) && !skip_break) {
+      halted = true;
+      return;
+    }
+    skip_break = false;
+  }
   //Fetch Opcodes
-  opcode = memory[PC] << 8 | memory[PC + 1];
+  const unsigned short fetch_pc = PC;
+  opcode = mem(PC) << 8 | mem(PC + 1);
   //Decode Opcodes
-  //In Vx,Vy Vx = (opcode & 0x0F00)>>8 and Vy = (opcode & 0x00F0)>>4
+  //The table in opcodes.h says which instruction this is, the operands
+  //come straight from the nibbles:
   //  x = (opcode & 0x0F00) >> 8;
   //  y = (opcode & 0x00F0) >> 4;
   //  n = (opcode & 0x000F);
   //  nn = (opcode & 0x00FF);
   //  nnn = (opcode & 0x0FFF);
-  //std::cout << "Opcode [0x0000]: 0x0" << opcode << "\n";
-  switch (opcode & 0xF000) {
-    case 0x0000: {
-      switch (opcode & 0xF00) {
-        case 0x0000:  // 0x00E0: Clears the screen
-          for (int i = 0; i < 2048; i++)
-            gfx[i] = 0x0;
-          drawFlag = true;
-          PC = PC + 2;
-          //std::cout << "clear" << std::endl;
-          break;
-        case 0x000E:  // 0x00EE: Returns from subroutine
-          --sp;
-          PC = stack[sp];
-          PC = PC + 2;
-          break;
-        default:
-          std::cout << "Unknown Opcode [0x0000]: 0x0" << opcode << "\n";
-      }
-    } break;
-    case 0x1000:  //1nnn - JP addr .Jump to location nnn
-      PC = opcode & 0x0F00;
-      //std::cout << "jump to " << PC << std::endl;
+  const instruction_form* form = decode(opcode);
+  const unsigned x = (opcode & 0x0F00) >> 8;
+  const unsigned y = (opcode & 0x00F0) >> 4;
+  const unsigned char nn = opcode & 0x00FF;
+  const unsigned short nnn = opcode & 0x0FFF;
+  //0NNN machine code routines aren't run, they stop like unknown opcodes
+  switch (form ? form->kind : op_kind::sys) {
+    case op_kind::cls:  // 0x00E0: Clears the screen
+      for (int i = 0; i < 2048; i++)
+        gfx[i] = 0x0;
+      drawFlag = true;
+      PC = PC + 2;
       break;
-    case 0x2000:  //2nnn - CALL addr .Call subroutine at nnn.
-      stack[sp] = PC;
-      ++sp;
-      PC = (opcode & 0x0FFF);
+    case op_kind::ret:  // 0x00EE: Returns from subroutine
+      sp = (sp - 1) & 0xF;
+      PC = stack_at(sp);
+      PC = PC + 2;
       break;
-    case 0x3000:  //3xkk - SE Vx, byte Skip next instruction if Vx = kk.
-      if (V[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF))
-        PC += 4;
-      else
-        PC += 2;
+    case op_kind::sys:
+      log_write(log_level::warning, log_event::unknown_opcode, PC, opcode);
       break;
-    case 0x4000:  //4xkk - SNE Vx, byte Skip next instruction if Vx != kk.
-      if (V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF))
-        PC += 4;
-      else
-        PC += 2;
+    case op_kind::jp:  //1nnn - JP addr .Jump to location nnn
+      PC = nnn;
       break;
-    case 0x5000:  // 5xy0 - SE Vx,Vy Skip next instruction if Vx = Vy.
-      if (V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 4])
-        PC += 4;
-      else
-        PC += 2;
+    case op_kind::call:  //2nnn - CALL addr .Call subroutine at nnn.
+      stack_at(sp) = PC;
+      sp = (sp + 1) & 0xF;
+      PC = nnn;
       break;
-    case 0x6000:  //6xkk - LD Vx, byte .Set Vx = kk. The interpreter puts the value kk into register Vx.
-      V[(opcode & 0x0F00) >> 8] = (opcode & 0x00FF);
+    case op_kind::se_byte:  //3xkk - SE Vx, byte Skip next instruction if Vx = kk.
+      PC += V[x] == nn ? 4 : 2;
+      break;
+    case op_kind::sne_byte:  //4xkk - SNE Vx, byte Skip next instruction if Vx != kk.
+      PC += V[x] != nn ? 4 : 2;
+      break;
+    case op_kind::se_reg:  // 5xy0 - SE Vx,Vy Skip next instruction if Vx = Vy.
+      PC += V[x] == V[y] ? 4 : 2;
+      break;
+    case op_kind::ld_byte:  //6xkk - LD Vx, byte .Set Vx = kk. The interpreter puts the value kk into register Vx.
+      V[x] = nn;
       PC += 2;
-      //std::cout << "set v" << ((opcode & 0x0F00) >> 8) << " to "<< (opcode & 0x00FF) << std::endl;
       break;
-    case 0x7000:  //7xkk - ADD Vx, byte.Set Vx = Vx + kk. Adds the value kk to the value of register Vx, then stores the result in Vx
-      V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x0F00) >> 8] + (opcode & 0x00FF);
+    case op_kind::add_byte:  //7xkk - ADD Vx, byte.Set Vx = Vx + kk. Adds the value kk to the value of register Vx, then stores the result in Vx
+      V[x] = V[x] + nn;
       PC += 2;
-      //std::cout << "add " << (opcode & 0x00FF) << " to v"<< ((opcode & 0x0F00) >> 8) << std::endl;
       break;
-    case 0x8000:
-      switch (opcode & 0x000F) {
-        case 0x0000:  //8XY0 - LD Vx,Vy
-          V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4];
-          PC += 2;
-          break;
-        case 0x0001:  //8XY1 - OR Vx,Vy
-          V[(opcode & 0x0F00) >> 8] =
-              V[(opcode & 0x0F00) >> 8] | V[(opcode & 0x00F0) >> 4];
-          PC += 2;
-          break;
-        case 0x0002:  //8XY2 - AND Vx,Vy
-          V[(opcode & 0x0F00) >> 8] =
-              V[(opcode & 0x0F00) >> 8] & V[(opcode & 0x00F0) >> 4];
-          PC += 2;
-          break;
-        case 0x0003:  //8xy3 - XOR Vx,Vy
-          V[(opcode & 0x0F00) >> 8] =
-              V[(opcode & 0x0F00) >> 8] ^ V[(opcode & 0x00F0) >> 4];
-          PC += 2;
-          break;
-        case 0x0004:
-          //8xy4 - ADD Vx, Vy Set Vx = Vx + Vy, set VF = carry. The values of Vx and Vy are added together.
-          // If the result is greater than 8 bits(i.e., > 255, ) VF is set to 1, otherwise 0. Only the lowest 8 bits of the result are kept, and stored in Vx.
-          if (V[(opcode & 0x00F0) >> 4] > (0xFF - V[(opcode & 0x0F00) >> 8]))
-            V[0xF] = 1;  //carry
-          else
-            V[0xF] = 0;
-          V[(opcode & 0x0F00) >> 8] =
-              V[(opcode & 0x0F00) >> 8] + V[(opcode & 0x00F0) >> 4];
-          PC += 2;
-          break;
-        case 0x0005:  //8XY5 - SUB Vx,Vy
-          if (V[(opcode & 0x00F0) >> 4] > V[(opcode & 0x0F00) >> 8])
-            V[0xF] = 0;
-          else
-            V[0xF] = 1;
-          V[(opcode & 0x0F00) >> 8] =
-              V[(opcode & 0x0F00) >> 8] - V[(opcode & 0x00F0) >> 4];
-          PC += 2;
-          break;
-        case 0x0006:
-          V[0xF] = V[(opcode & 0x0F00) >> 8] & 0x1;
-          V[(opcode & 0x0F00) >> 8] >>= 1;
-          PC += 2;
-          break;
-        case 0x0007:
-          if (V[(opcode & 0x00F0) >> 4] > V[(opcode & 0x0F00) >> 8])
-            V[0xF] = 1;
-          else
-            V[0xF] = 0;
-          PC += 2;
-          break;
-        case 0x000E:
-          V[0xF] = V[(opcode & 0x0F00) >> 8] >> 8;
-          V[(opcode & 0x0F00) >> 8] <<= 1;
-          PC += 2;
-          break;
-        default:
-          std::cout << "Unknown opcode: 0x8" << opcode << "\n";
-      }
+    case op_kind::ld_reg:  //8XY0 - LD Vx,Vy
+      V[x] = V[y];
+      PC += 2;
       break;
-    case 0x9000:
-      if (V[(opcode & 0x0F00) >> 8] != V[(opcode & 0x00F0) >> 4])
-        PC += 4;
-      else
-        PC += 2;
+    case op_kind::or_reg:  //8XY1 - OR Vx,Vy
+      V[x] = V[x] | V[y];
+      PC += 2;
+      break;
+    case op_kind::and_reg:  //8XY2 - AND Vx,Vy
+      V[x] = V[x] & V[y];
+      PC += 2;
       break;
-    case 0xA000:  // ANNN: Sets I to the address NNN
+    case op_kind::xor_reg:  //8xy3 - XOR Vx,Vy
+      V[x] = V[x] ^ V[y];
+      PC += 2;
+      break;
+    case op_kind::add_reg:
+      //8xy4 - ADD Vx, Vy Set Vx = Vx + Vy, set VF = carry. The values of Vx and Vy are added together.
+      // If the result is greater than 8 bits(i.e., > 255, ) VF is set to 1, otherwise 0. Only the lowest 8 bits of the result are kept, and stored in Vx.
+      // VF is written last so it holds the flag even when X is F.
+      {
+        const unsigned char carry = V[y] > (0xFF - V[x]);
+        V[x] = V[x] + V[y];
+        V[0xF] = carry;
+      }
+      PC += 2;
+      break;
+    case op_kind::sub_reg:  //8XY5 - SUB Vx,Vy. Set Vx = Vx - Vy, VF = NOT borrow.
+    {
+      const unsigned char no_borrow = V[x] >= V[y];
+      V[x] = V[x] - V[y];
+      V[0xF] = no_borrow;
+      PC += 2;
+    } break;
+    case op_kind::shr:  //8XY6 - SHR Vx. VF = least significant bit of Vx.
+    {
+      const unsigned char lsb = V[x] & 0x1;
+      V[x] >>= 1;
+      V[0xF] = lsb;
+      PC += 2;
+    } break;
+    case op_kind::subn_reg:  //8XY7 - SUBN Vx,Vy. Set Vx = Vy - Vx, VF = NOT borrow.
     {
-      I = (opcode & 0x0FFF);
+      const unsigned char no_borrow = V[y] >= V[x];
+      V[x] = V[y] - V[x];
+      V[0xF] = no_borrow;
+      PC += 2;
+    } break;
+    case op_kind::shl:  //8XYE - SHL Vx. VF = most significant bit of Vx.
+    {
+      const unsigned char msb = V[x] >> 7;
+      V[x] <<= 1;
+      V[0xF] = msb;
+      PC += 2;
+    } break;
+    case op_kind::sne_reg:  //9xy0 - SNE Vx,Vy Skip next instruction if Vx != Vy.
+      PC += V[x] != V[y] ? 4 : 2;
+      break;
+    case op_kind::ld_i:  // ANNN: Sets I to the address NNN
+      I = nnn;
       PC = PC + 2;
-      //std::cout << "set index to " << (opcode & 0x0FFF) << std::endl;
       break;
-    }
-    case 0xB000:  // Bnnn - JP V0, addr Jump to location nnn + V0. The program counter is set to nnn plus the value of V0.
-      PC = ((opcode & 0x0FFF) + V[0x0]);
+    case op_kind::jp_v0:  // Bnnn - JP V0, addr Jump to location nnn + V0. The program counter is set to nnn plus the value of V0.
+      PC = nnn + V[0x0];
       break;
-    case 0xC000:  //Cxkk - RND Vx, byte Set Vx = random byte AND kk. The interpreter generates a random number from 0 to 255,
+    case op_kind::rnd:  //Cxkk - RND Vx, byte Set Vx = random byte AND kk. The interpreter generates a random number from 0 to 255,
       // which is then ANDed with the value kk.The results are stored in Vx
-      V[(opcode & 0x0F00) >> 8] =
-          (0 + (std::rand() % (255 - 0 + 1))) & (opcode & 0x00FF);
+      V[x] = random_byte() & nn;
       PC += 2;
       break;
-    case 0xD000:  //Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision. The interpreter reads n bytes from memory,
+    case op_kind::drw:  //Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision. The interpreter reads n bytes from memory,
       // starting at the address stored in I.These bytes are then displayed as sprites on screen at coordinates(Vx, Vy).
       // Sprites are XORed onto the existing screen.If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
       // If the sprite is positioned so part of itis outside the coordinates of the display, it wraps around to the opposite side of the screen.
       {
-        unsigned short Vx = V[(opcode & 0x0F00) >> 8];
-        unsigned short Vy = V[(opcode & 0x00F0) >> 4];
+        unsigned short Vx = V[x] & 63;
+        unsigned short Vy = V[y] & 31;
         unsigned short height = (opcode & 0x000F);
         unsigned short pixel;
-        //std::cout << "draw (" << Vx << ", " << Vy << ")" << std::endl;
+        //Column wrap is the same for every row, work it out once per sprite
+        unsigned char column[8];
+        for (int xline = 0; xline < 8; xline++)
+          column[xline] = (Vx + xline) & 63;
         V[0xF] = 0;
         for (int yline = 0; yline < height; yline++) {
-          pixel = memory[I + yline];
+          pixel = mem(I + yline);
+          unsigned char* row = &gfx[((Vy + yline) & 31) * 64];
           for (int xline = 0; xline < 8; xline++) {
             if ((pixel & (0x80 >> xline)) != 0) {
-              if (gfx[(Vx + xline + ((Vy + yline) * 64))] != 0) {
+              if (row[column[xline]] != 0) {
                 V[0xF] = 1;
               }
-              gfx[Vx + xline + ((Vy + yline) * 64)] ^= 1;
+              row[column[xline]] ^= 1;
             }
           }
         }
         drawFlag = true;
+        vblank_wait = true;
         PC += 2;
       }
       break;
-    case 0xE000:  //Ex9E - SKP Vx Skip next instruction if key with the value of Vx is pressed.
+    case op_kind::skp:  //Ex9E - SKP Vx Skip next instruction if key with the value of Vx is pressed.
       // Checks the keyboard, and if the key corresponding to the value of Vx is currently in thedown position,
       // PC is increased by 2.
-      switch (opcode & 0x00FF) {
-        case 0x009E:  //EX9E - SKP VX
-          if (key[V[(opcode & 0x0F00) >> 8]] == 1)
-            PC += 4;
-          else
-            PC += 2;
-          break;
-        case 0x00A1:  //EXA1 - SKNP VX. Skip the next instruction if the key with the value of VX is currently not pressed.
-          if (key[V[(opcode & 0x0F00) >> 8]] == 0)
-            PC += 4;
-          else
-            PC += 2;
-          break;
-        default:
-          std::cout << "Unknown Opcode:0xE" << (opcode) << "\n";
-      }
+      PC += key[V[x] & 0xF] == 1 ? 4 : 2;
       break;
-    case 0xF000:
-      switch (opcode & 0x00FF) {
-        case 0x0007:  //FX07 - LD VX, DT . Read the delay timer register value into VX
-          V[(opcode & 0x0F00) >> 8] = delay_timer;
-          PC += 2;
-          break;
-        case 0x000A:  // FX0A - LD VX, K.Wait for a key press, and then store the value of the key to VX
-        {
-          bool key_press = false;
-          for (int i = 0; i < 16; ++i) {
-            if (key[i] != 0)
-              V[(opcode & 0x0F00) >> 8] = i;
-            key_press = true;
-          }
-          //If we didn't have any key pressed we skip the cycle eniterly
-          if (!key_press)
-            return;
-
-          PC += 2;
-        } break;
-        case 0x0015:  //FX15 - LD DT, VX .Load the value of VX into the delay timer DT.
-          delay_timer = V[(opcode & 0x0F00) >> 8];
-          PC += 2;
-          break;
-        case 0x0018:  //FX18 - LD ST, VX.Load the value of VX into the sound time ST
-          sound_timer = V[(opcode & 0x0F00) >> 8];
-          PC += 2;
-          break;
-        case 0x001E:  //FX1E - ADD I, VX.Add the values of I and VX, and store the result in I.
-          if (I + V[(opcode & 0x0F00) >> 8] > 0xFFF)
-            V[0xF] = 1;
-          else
-            V[0xF] = 0;
-          I += V[(opcode & 0x0F00) >> 8];
-          PC += 2;
-          break;
-        case 0x0029:  //FX29 - LD F, VX. Set the location of the sprite for the digit VX to I.
-          //The font sprites start at address 0x000, and contain the hexadecimal digits from 1..F.
-          //Each font has a length of 0x05 bytes. The memory address for the value in VX is put in I
-          I = V[(opcode & 0x0F00) >> 8] * 0x05;
-          PC += 2;
-          break;
-        case 0x0033:  //FX33 - LD B, VX. Store the binary-coded decimal in VX and put it in three consecutive memory slots starting at I.
-          //VX is a byte, so it is in 0…255. The interpreter takes the value in VX (for example the decimal value 174, or 0xAE in hex), converts it into a decimal and separates the hundreds, the tens and the ones (1, 7 and 4 respectively).
-          //Then, it stores them in three memory locations starting at I (1 to I, 7 to I+1 and 4 to I+2).
-          memory[I] = V[(opcode & 0x0F00) >> 8] / 100;
-          memory[I + 1] = (V[(opcode & 0x0F00) >> 8] / 10) % 10;
-          memory[I + 2] = (V[(opcode & 0x0F00) >> 8] % 100) % 10;
-          PC += 2;
-          break;
-        case 0x0055:  //FX55 - LD [I], VX.Store registers from V0 to VX in the main memory, starting at location I.
-          //Note that X is the number of the register, so we can use it in the loop.
-          for (int i = 0; i < ((opcode & 0x0F00) >> 8); ++i) {
-            memory[I + i] = V[i];
-          }
-          I = I + ((opcode & 0x0F00) >> 8) + 1;  //I = I + x + 1
-          PC += 2;
-          break;
-        case 0x065:  //FX65 - LD VX, [I]. Load the memory data starting at address I into the registers V0 to VX.
-          for (int i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
-            V[i] = memory[I + i];
-          I = I + ((opcode & 0x0F00) >> 8) + 1;  //I = I + x +1
-          PC += 2;
-          break;
-        default:
-          std::cout << "Unknown Opcode:0xF" << opcode << "\n";
+    case op_kind::sknp:  //EXA1 - SKNP VX. Skip the next instruction if the key with the value of VX is currently not pressed.
+      PC += key[V[x] & 0xF] == 0 ? 4 : 2;
+      break;
+    case op_kind::ld_from_dt:  //FX07 - LD VX, DT . Read the delay timer register value into VX
+      V[x] = delay_timer;
+      PC += 2;
+      break;
+    case op_kind::ld_key:  // FX0A - LD VX, K.Wait for a key press and release, and then store the value of the key to VX
+    {
+      //Only keys released after the wait started count
+      if (!key_wait) {
+        key_wait = true;
+        key_released = 0;
       }
+      //If no key went up yet we skip the cycle eniterly
+      if (key_released == 0)
+        return;
+
+      unsigned char k = 0;
+      while ((key_released & (1 << k)) == 0)
+        ++k;
+      V[x] = k;
+      key_wait = false;
+      PC += 2;
+    } break;
+    case op_kind::ld_dt:  //FX15 - LD DT, VX .Load the value of VX into the delay timer DT.
+      delay_timer = V[x];
+      PC += 2;
+      break;
+    case op_kind::ld_st:  //FX18 - LD ST, VX.Load the value of VX into the sound time ST
+      sound_timer = V[x];
+      sound_changed();
+      PC += 2;
+      break;
+    case op_kind::add_i:  //FX1E - ADD I, VX.Add the values of I and VX, and store the result in I.
+    {
+      const unsigned char overflow = I + V[x] > 0xFFF;
+      I += V[x];
+      V[0xF] = overflow;
+      PC += 2;
+    } break;
+    case op_kind::ld_font:  //FX29 - LD F, VX. Set the location of the sprite for the digit VX to I.
+      //The font sprites start at address 0x000, and contain the hexadecimal digits from 1..F.
+      //Each font has a length of 0x05 bytes. The memory address for the value in VX is put in I
+      I = V[x] * 0x05;
+      PC += 2;
+      break;
+    case op_kind::ld_bcd:  //FX33 - LD B, VX. Store the binary-coded decimal in VX and put it in three consecutive memory slots starting at I.
+      //VX is a byte, so it is in 0…255. The interpreter takes the value in VX (for example the decimal value 174, or 0xAE in hex), converts it into a decimal and separates the hundreds, the tens and the ones (1, 7 and 4 respectively).
+      //Then, it stores them in three memory locations starting at I (1 to I, 7 to I+1 and 4 to I+2).
+      //The digits of every value are worked out at compile time.
+      chip8_write(*this, I, chip8_bcd.digits[V[x]], 3);
+      stored(I, 3);
+      PC += 2;
+      break;
+    case op_kind::ld_store:  //FX55 - LD [I], VX.Store registers from V0 to VX in the main memory, starting at location I.
+      //Note that X is the number of the register, so V0..VX is X + 1 bytes.
+      chip8_write(*this, I, V, x + 1);
+      stored(I, x + 1);
+      I = I + x + 1;
+      PC += 2;
+      break;
+    case op_kind::ld_load:  //FX65 - LD VX, [I]. Load the memory data starting at address I into the registers V0 to VX.
+      chip8_read(*this, I, V, x + 1);
+      I = I + x + 1;
+      PC += 2;
       break;
-    default:
-      std::cout << "Unknown Opcode: 0x" << opcode;
   }
   //Execute Opcodes
 
-  //Update Timers
+  if (tracer) {
+    const unsigned char reg = trace_written_reg(opcode);
+    tracer->record(cycles, fetch_pc, opcode, I, reg,
+                   reg == trace_no_reg ? 0 : V[reg]);
+  }
+  ++cycles;
+}
+
+//Runs one 60 Hz frame. With a fixed speed that is a fixed number of
+//instructions, with the VIP timing model every instruction is charged its
+//VIP cost against the frame's time until it runs out or a sprite is drawn.
+//Overshoot is carried into the next frame so the average rate stays exact.
+void chip8::run_frame(input* events) {
+  //Halted by the debugger, time stands still until resume()
+  if (halted)
+    return;
+  if (ipf > 0) {
+    for (int i = 0; i < ipf && !halted;) {
+      if (events)
+        events->drain(*this);
+      //Instructions are spread evenly over the frame
+      frame_offset = static_cast<long>(i) * frame_time / ipf;
+      const int executed = run_compiled(ipf - i);
+      if (executed > 0) {
+        i += executed;
+      } else {
+        emulate_cycle();
+        ++i;
+      }
+    }
+  } else {
+    budget += frame_time;
+    vblank_wait = false;
+    while (budget > 0 && !vblank_wait) {
+      if (events)
+        events->drain(*this);
+      frame_offset = frame_time - budget;
+      emulate_cycle();
+      if (halted)
+        break;
+      budget -= vip_cost(opcode);
+    }
+    //The draw waited for the display interrupt, the next frame starts fresh
+    if (vblank_wait)
+      budget = 0;
+  }
+  //The timers count down at the end of the frame
+  frame_offset = frame_time;
+  tick_timers();
+  ++frames;
+  frame_offset = 0;
+}
+
+//Runs the compiled or translated block at PC if there is one of at most
+//limit instructions, returns how many instructions it executed.
+int chip8::run_compiled(int limit) {
+  if (tracer || breaks)
+    return 0;
+  const chip8_host host = {random_hook, stored_hook, this};
+  chip8_block_result result = {0, 0};
+  const chip8_block* block = compiled ? compiled->at(PC, memory) : nullptr;
+  if (block && block->instructions <= limit)
+    result = block->run(*this, host);
+  else if (native)
+    result = native->run(*this, host, limit);
+  cycles += result.instructions;
+  if (result.flags & block_drew)
+    drawFlag = true;
+  if (result.flags & block_vblank)
+    vblank_wait = true;
+  return result.instructions;
+}
+
+void chip8::stored(unsigned first, unsigned count) {
+  if (breaks && breaks->write(first, count))
+    halted = true;
+  code_written(first, count);
+}
+
+void chip8::code_written(unsigned first, unsigned count) {
+  if (compiled)
+    compiled->invalidate(first, count);
+  if (native)
+    native->invalidate(first, count);
+}
+
+//Stores made by compiled and translated code
+void chip8::stored_hook(void* context, unsigned first, unsigned count) {
+  static_cast<chip8*>(context)->stored(first, count);
+}
+
+unsigned char chip8::random_hook(void* context) {
+  return static_cast<chip8*>(context)->random_byte();
+}
+
+void chip8::tick_timers() {
   if (delay_timer > 0) {
     --delay_timer;
   }
   if (sound_timer > 0) {
-    if (sound_timer == 1) {
-      std::cout << "BEEP\n";
-    }
     --sound_timer;
+    sound_changed();
   }
 }
 
+void chip8::sound_changed() {
+  if (sound_active() == sounding)
+    return;
+  sounding = sound_active();
+  if (sound)
+    sound->sound_edge(frames * frame_time + frame_offset, sounding);
+}
+
+void chip8::key_event(unsigned char k, bool pressed) {
+  key[k & 0xF] = pressed ? 1 : 0;
+  //Latch releases so a press and release between two instructions is not lost
+  if (!pressed)
+    key_released |= 1 << (k & 0xF);
+}
+
 bool chip8::load_game(const std::string& file_name) {
   //initialize();
   std::ifstream input_file;
   input_file.open(file_name,
                   std::ios::binary | std::ios::in);  //Read in binary mode
   if (!input_file) {
-    std::cerr << "Could not open the file.\n "
-              << "Check for correct filename or file extension.";
+    log_write(log_level::error, log_event::rom_open_failed);
     return false;
   }
-  int i = 0;
-  char b;
-  while (input_file.get(b)) {
-    memory[i + 512] = b;
-    i++;
-  }
+  const std::vector<unsigned char> rom(
+      (std::istreambuf_iterator<char>(input_file)),
+      std::istreambuf_iterator<char>());
   input_file.close();
-  std::cout << "Successfully parsed CHIP8 file......\n";
+  return load_game(rom.data(), rom.size());
+}
+
+//Programs are loaded at 0x200, anything that doesn't fit below 0x1000 is
+//rejected before memory is touched.
+bool chip8::load_game(const unsigned char* data, std::size_t size) {
+  if (size > 4096 - 512) {
+    log_write(log_level::error, log_event::rom_too_large, 0, 0,
+              static_cast<uint32_t>(size));
+    return false;
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    memory[i + 512] = data[i];
+  }
+  code_written(512, static_cast<unsigned>(size));
+  log_write(log_level::info, log_event::rom_loaded, 0, 0,
+            static_cast<uint32_t>(size));
   return true;
 }
@@ -1,19 +1,98 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
+#include <cstddef>
 #include <string>
-class chip8
+
+class breakpoints;
+class compiled_rom;
+class input;
+class jit;
+class trace_recorder;
+
+//Told about every sound timer on/off edge when it happens, stamped with
+//emulated time: microseconds of 60 Hz frames since initialize(), plus how
+//far into its frame the instruction ran.
+class sound_listener
+{
+public:
+    virtual ~sound_listener() = default;
+    virtual void sound_edge(unsigned long long time, bool on) = 0;
+};
+
+//Complete machine state. Kept as a plain struct so tools can snapshot,
+//compare and restore it without going through the interpreter.
+//Everything an instruction touches besides memory and the display sits in
+//the first two cache lines, registers and keys in the first, the stack in
+//the second.
+struct alignas(64) chip8_state
+{
+    unsigned char V[16];        // CPU Register of chip8
+    unsigned short I;           // Index register I
+    unsigned short PC;          // Program counter
+    unsigned short opcode;      // OPCode of Chip8
+    unsigned short sp; //Stack pointer
+    unsigned char delay_timer;
+    unsigned char sound_timer;
+    unsigned short key_released; //Keys released while FX0A is waiting, one bit per key
+    bool key_wait;               //FX0A is waiting for a key
+    unsigned char key[16];      // Keypad
+    alignas(64) unsigned short stack[16];
+    alignas(64) unsigned char memory[4096]; // memory of chip8
+    unsigned char gfx[64 * 32]; // display
+};
+static_assert(offsetof(chip8_state, key) + sizeof(chip8_state::key) <= 64,
+              "registers and keys must share the first cache line");
+static_assert(offsetof(chip8_state, stack) == 64 &&
+                  offsetof(chip8_state, memory) == 128,
+              "the stack must fill the second cache line");
+static_assert(offsetof(chip8_state, gfx) % 64 == 0,
+              "the display must start on a cache line");
+
+class chip8 : private chip8_state
 {
 public:
     chip8();
     ~chip8();
+    static constexpr int frame_time = 16667; // microseconds at 60 Hz
     void emulate_cycle();
+    void run_frame(input* events = nullptr);
+    void tick_timers();
+    //Instructions per frame, 0 schedules by VIP instruction timing instead
+    void set_speed(int instructions_per_frame) { ipf = instructions_per_frame; }
     bool load_game(const std::string &file_name);
+    bool load_game(const unsigned char* data, std::size_t size);
+    void key_event(unsigned char k, bool pressed);
+    bool sound_active() const { return sound_timer > 0; }
+    //Receives the sound timer's edges, nullptr for none
+    void set_sound_listener(sound_listener* listener) { sound = listener; }
+    //CXNN's generator, initialize() seeds it from the clock
+    void seed_random(unsigned seed);
+    //Records every executed instruction while set, nullptr disables tracing
+    void set_trace(trace_recorder* recorder) { tracer = recorder; }
+    unsigned long long cycle_count() const { return cycles; }
+    //Code compiled ahead of time for the loaded ROM, used by run_frame at
+    //fixed speed while neither tracing nor breakpoints are on
+    void set_compiled(compiled_rom* code) { compiled = code; }
+    //Translates hot code to native code under the same conditions, for
+    //whatever the compiled ROM doesn't cover
+    void set_jit(jit* translator) { native = translator; }
+    //Halts before executing a PC breakpoint and after writing a watched
+    //address. nullptr disables the checks.
+    void set_breakpoints(const breakpoints* bp) { breaks = bp; }
+    //While halted run_frame does nothing, timers included
+    bool is_halted() const { return halted; }
+    void halt() { halted = true; }
+    //The next instruction runs even if its address is a breakpoint
+    void resume() { halted = false; skip_break = true; }
+    void step() { resume(); emulate_cycle(); halted = true; }
+    const chip8_state& state() const { return *this; }
+    chip8_state& state() { return *this; }
     bool drawFlag;
-    unsigned char gfx[64 * 32]; // display
-    unsigned char key[16];      // Keypad
+    using chip8_state::gfx;
+    using chip8_state::key;
     //For font visit: https://tobiasvl.github.io/blog/write-a-chip-8-emulator/
-    unsigned char chip8_font[80] = {
+    static constexpr unsigned char chip8_font[80] = {
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
         0x20, 0x60, 0x20, 0x20, 0x70, // 1
         0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
@@ -35,15 +114,36 @@ public:
     void initialize();
 
 private:
-    unsigned short opcode;      // OPCode of Chip8
-    unsigned char memory[4096]; // memory of chip8
-    unsigned char V[16];        // CPU Register of chip8
-    unsigned short I;           // Index register I
-    unsigned short PC;          // Program counter
-    unsigned char delay_timer;
-    unsigned char sound_timer;
-    unsigned short stack[16];
-    unsigned short sp; //Stack pointer
+    //All indexing goes through these so out-of-range addresses wrap like
+    //the hardware's address lines instead of leaving the arrays.
+    unsigned char& mem(unsigned address) { return memory[address & 0xFFF]; }
+    unsigned short& stack_at(unsigned index) { return stack[index & 0xF]; }
+    int run_compiled(int limit);
+    //Every store into memory goes through here: write breakpoints, and
+    //dropping cached code over the written bytes
+    void stored(unsigned first, unsigned count);
+    void code_written(unsigned first, unsigned count);
+    static void stored_hook(void* context, unsigned first, unsigned count);
+    unsigned char random_byte();
+    static unsigned char random_hook(void* context);
+    //Reports the sound timer starting or stopping since the last call
+    void sound_changed();
+
+    unsigned long long cycles;   //Instructions executed since initialize()
+    int ipf = 11;                //Instructions per frame, 0 for VIP timing
+    long budget;                 //Microseconds left in the current frame
+    unsigned long long frames = 0;  //Frames run since initialize()
+    long frame_offset = 0;       //Microseconds into the frame of the current instruction
+    bool sounding = false;       //Last edge sent to the sound listener
+    sound_listener* sound = nullptr;
+    bool vblank_wait;            //DXYN ended the frame
+    trace_recorder* tracer = nullptr;
+    const breakpoints* breaks = nullptr;
+    compiled_rom* compiled = nullptr;
+    jit* native = nullptr;
+    bool halted = false;         //Paused by the debugger or a breakpoint
+    bool skip_break = false;     //Resuming from a PC breakpoint
+    unsigned random_state = 1;   //xorshift32 state for CXNN
 };
 
 #endif
\ No newline at end of file
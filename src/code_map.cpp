@@ -0,0 +1,149 @@
+#include "code_map.h"
+#include <algorithm>
+#include <cstdio>
+#include "disasm.h"
+
+namespace {
+
+void sort_unique(std::vector<uint16_t>& addresses) {
+  std::sort(addresses.begin(), addresses.end());
+  addresses.erase(std::unique(addresses.begin(), addresses.end()),
+                  addresses.end());
+}
+
+}  // namespace
+
+code_map map_code(const unsigned char* rom, std::size_t size,
+                  uint16_t origin) {
+  code_map map;
+  map.origin = origin;
+  map.kind.assign(size, byte_data);
+  auto inside = [&](unsigned address) {
+    return address >= origin && address + 1 < origin + size;
+  };
+
+  std::vector<uint16_t> pending{origin};
+  std::vector<uint16_t> leaders{origin};
+  while (!pending.empty()) {
+    unsigned address = pending.back();
+    pending.pop_back();
+    while (inside(address) && map.kind[address - origin] != byte_opcode) {
+      const std::size_t at = address - origin;
+      map.kind[at] = byte_opcode;
+      if (map.kind[at + 1] == byte_data)
+        map.kind[at + 1] = byte_operand;
+      const uint16_t opcode = rom[at] << 8 | rom[at + 1];
+      const instruction_form* form = decode(opcode);
+      if (!form)
+        break;  // the interpreter stalls on unknown opcodes
+      const uint16_t nnn = opcode & 0x0FFF;
+      if (form->kind == op_kind::ld_i)
+        map.targets.push_back(nnn);
+      bool falls_through = true;
+      switch (form->flow) {
+        case control::next:
+          break;
+        case control::skip:
+          pending.push_back(address + 4);
+          leaders.push_back(address + 2);
+          leaders.push_back(address + 4);
+          break;
+        case control::jump:
+          pending.push_back(nnn);
+          map.targets.push_back(nnn);
+          leaders.push_back(nnn);
+          falls_through = false;
+          break;
+        case control::call:
+          pending.push_back(nnn);
+          map.targets.push_back(nnn);
+          leaders.push_back(nnn);
+          leaders.push_back(address + 2);
+          break;
+        case control::indirect:
+          //Usually a jump table at NNN, follow the V0 = 0 entry at least
+          map.indirect = true;
+          pending.push_back(nnn);
+          map.targets.push_back(nnn);
+          leaders.push_back(nnn);
+          falls_through = false;
+          break;
+        case control::ret:
+        case control::stop:
+          falls_through = false;
+          break;
+      }
+      if (!falls_through)
+        break;
+      address += 2;
+    }
+  }
+
+  sort_unique(map.targets);
+  for (uint16_t leader : leaders) {
+    if (inside(leader) && map.kind[leader - origin] == byte_opcode)
+      map.blocks.push_back(leader);
+  }
+  sort_unique(map.blocks);
+  return map;
+}
+
+std::string list_code(const unsigned char* rom, std::size_t size,
+                      const code_map& map) {
+  const unsigned origin = map.origin;
+  //Where lines start, an instruction that overlaps another one is only
+  //reachable through its address and gets no label
+  std::vector<bool> line_start(size, false);
+  for (std::size_t at = 0; at < size;) {
+    line_start[at] = true;
+    at += map.kind[at] == byte_opcode && at + 1 < size ? 2 : 1;
+  }
+  std::vector<bool> labeled(size, false);
+  for (uint16_t target : map.targets) {
+    if (target >= origin && target < origin + size &&
+        line_start[target - origin])
+      labeled[target - origin] = true;
+  }
+  auto label_of = [&](unsigned address) {
+    char name[8];
+    std::snprintf(name, sizeof(name), "L%03X", address);
+    return std::string(name);
+  };
+
+  std::string text;
+  char line[64];
+  for (std::size_t at = 0; at < size;) {
+    const unsigned address = origin + at;
+    if (labeled[at])
+      text += label_of(address) + ":\n";
+    if (map.kind[at] == byte_opcode && at + 1 < size) {
+      const uint16_t opcode = rom[at] << 8 | rom[at + 1];
+      const instruction_form* form = decode(opcode);
+      const unsigned nnn = opcode & 0x0FFF;
+      std::string label;
+      if (form && (operand_bits(*form) & 0x0FFF) == 0x0FFF &&
+          nnn >= origin && nnn < origin + size && labeled[nnn - origin])
+        label = label_of(nnn);
+      if (form && (opcode & ~operand_bits(*form)) != form->match) {
+        //Bits the mnemonic can't express, e.g. the low nibble of 5XY1
+        std::snprintf(line, sizeof(line), "  DW 0x%04X  ; ", opcode);
+        text += line + disassemble(opcode) + "\n";
+      } else {
+        text += "  " + disassemble(opcode, label) + "\n";
+      }
+      at += 2;
+      continue;
+    }
+    text += "  DB";
+    const std::size_t first = at;
+    do {
+      std::snprintf(line, sizeof(line), "%s0x%02X", at == first ? " " : ", ",
+                    rom[at]);
+      text += line;
+      ++at;
+    } while (at < size && at - first < 8 && !labeled[at] &&
+             map.kind[at] != byte_opcode);
+    text += "\n";
+  }
+  return text;
+}
@@ -0,0 +1,28 @@
+#ifndef CODE_MAP_H
+#define CODE_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum byte_kind : unsigned char { byte_data, byte_opcode, byte_operand };
+
+//Which bytes of a ROM are code, found by recursive descent from the entry
+//point through jump, call and skip targets.
+struct code_map {
+  uint16_t origin = 0x200;
+  std::vector<unsigned char> kind;  // byte_kind of every ROM byte
+  std::vector<uint16_t> targets;    // jump, call and LD I addresses, sorted
+  std::vector<uint16_t> blocks;     // basic block start addresses, sorted
+  bool indirect = false;            // BNNN seen, code it reaches may be missing
+};
+
+code_map map_code(const unsigned char* rom, std::size_t size,
+                  uint16_t origin = 0x200);
+//Listing chip8-asm assembles back to the same bytes: instructions with
+//labels where map found code, DB for everything else.
+std::string list_code(const unsigned char* rom, std::size_t size,
+                      const code_map& map);
+
+#endif
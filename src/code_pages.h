@@ -0,0 +1,55 @@
+#ifndef CODE_PAGES_H
+#define CODE_PAGES_H
+
+#include <cstdint>
+
+//Which 64-byte pages of the 4 KB address space hold cached or translated
+//code, one bit per page. Every store checks the bits of the pages it lands
+//in; only a store that hits one makes the cache look for blocks to drop.
+class code_pages {
+ public:
+  static constexpr unsigned page_size = 64;
+
+  //Pages covering [start, end)
+  void mark(unsigned start, unsigned end) {
+    if (start < end)
+      m_bits |= mask(start, end - start);
+  }
+  //Whether a store of count bytes from first, wrapping like the memory,
+  //lands in a marked page
+  bool touches(unsigned first, unsigned count) const {
+    return m_bits && count && (m_bits & mask(first, count));
+  }
+  void clear() { m_bits = 0; }
+
+  //Calls f(lo, hi) for the one or two unwrapped ranges a store of count
+  //bytes from first covers
+  template <typename F>
+  static void ranges(unsigned first, unsigned count, F f) {
+    first &= 0xFFF;
+    if (count >= 0x1000) {
+      f(0u, 0x1000u);
+    } else if (first + count > 0x1000) {
+      f(first, 0x1000u);
+      f(0u, first + count - 0x1000);
+    } else {
+      f(first, first + count);
+    }
+  }
+
+ private:
+  static uint64_t mask(unsigned first, unsigned count) {
+    if (count >= 0x1000)
+      return ~uint64_t(0);
+    const unsigned a = (first & 0xFFF) / page_size;
+    const unsigned b = ((first + count - 1) & 0xFFF) / page_size;
+    //2 << 63 is 0, which makes the all-pages case come out right
+    if (a <= b)
+      return ((uint64_t(2) << (b - a)) - 1) << a;
+    return ~uint64_t(0) << a | ((uint64_t(2) << b) - 1);
+  }
+
+  uint64_t m_bits = 0;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "compiled.h"
+#include <algorithm>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace {
+
+void* open_library(const std::string& file_name) {
+#if defined(_WIN32)
+  return reinterpret_cast<void*>(LoadLibraryA(file_name.c_str()));
+#else
+  return dlopen(file_name.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+void* find_symbol(void* library, const char* name) {
+#if defined(_WIN32)
+  return reinterpret_cast<void*>(
+      GetProcAddress(reinterpret_cast<HMODULE>(library), name));
+#else
+  return dlsym(library, name);
+#endif
+}
+
+void close_library(void* library) {
+#if defined(_WIN32)
+  FreeLibrary(reinterpret_cast<HMODULE>(library));
+#else
+  dlclose(library);
+#endif
+}
+
+}  // namespace
+
+#if defined(_WIN32)
+const char* const compiled_rom::library_suffix = ".dll";
+#else
+const char* const compiled_rom::library_suffix = ".so";
+#endif
+
+compiled_rom::~compiled_rom() {
+  unload();
+}
+
+bool compiled_rom::load(const std::string& library, uint64_t rom_hash,
+                        std::size_t rom_size) {
+  unload();
+  m_library = open_library(library);
+  if (!m_library)
+    return false;
+  const auto entry = reinterpret_cast<chip8_plugin_entry_fn>(
+      find_symbol(m_library, CHIP8_PLUGIN_ENTRY));
+  const chip8_plugin* plugin = entry ? entry() : nullptr;
+  if (!plugin || plugin->version != chip8_plugin_version ||
+      plugin->rom_size != rom_size || plugin->rom_hash != rom_hash) {
+    unload();
+    return false;
+  }
+  m_plugin = plugin;
+  for (uint32_t i = 0; i < plugin->block_count; ++i) {
+    const chip8_block& block = plugin->blocks[i];
+    if (block.start < block.end && block.end <= 0x1000) {
+      m_by_pc[block.start] = &block;
+      m_stale[block.start] = true;
+      m_pages.mark(block.start, block.end);
+      m_longest = std::max<unsigned>(m_longest, block.end - block.start);
+    }
+  }
+  return true;
+}
+
+void compiled_rom::mark_stale(unsigned first, unsigned count) {
+  //Only blocks starting less than m_longest bytes before a written byte
+  //can contain it
+  code_pages::ranges(first, count, [this](unsigned lo, unsigned hi) {
+    for (unsigned pc = lo > m_longest ? lo - m_longest : 0; pc < hi; ++pc) {
+      if (m_by_pc[pc] && m_by_pc[pc]->end > lo)
+        m_stale[pc] = true;
+    }
+  });
+}
+
+void compiled_rom::unload() {
+  std::fill(m_by_pc.begin(), m_by_pc.end(), nullptr);
+  std::fill(m_stale.begin(), m_stale.end(), false);
+  m_pages.clear();
+  m_longest = 0;
+  m_plugin = nullptr;
+  if (m_library)
+    close_library(m_library);
+  m_library = nullptr;
+}
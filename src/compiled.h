@@ -0,0 +1,67 @@
+#ifndef COMPILED_H
+#define COMPILED_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "code_pages.h"
+#include "plugin_abi.h"
+
+//A ROM compiled ahead of time by chip8-recompile, loaded from a shared
+//library. Blocks are looked up by PC. A store into a block's page marks it
+//stale, and a stale block is checked against memory before it runs again:
+//one whose bytes no longer match what was compiled (self-modifying code) is
+//left to the interpreter.
+class compiled_rom {
+ public:
+  static const char* const library_suffix;  // ".dll" or ".so"
+
+  compiled_rom() = default;
+  compiled_rom(const compiled_rom&) = delete;
+  compiled_rom& operator=(const compiled_rom&) = delete;
+  ~compiled_rom();
+
+  //Fails when the library can't be loaded or was compiled from another ROM
+  bool load(const std::string& library, uint64_t rom_hash,
+            std::size_t rom_size);
+  std::size_t block_count() const {
+    return m_plugin ? m_plugin->block_count : 0;
+  }
+
+  //Block starting at pc, nullptr when there is none or it was overwritten
+  const chip8_block* at(unsigned pc, const unsigned char* memory) {
+    if (pc >= 0x1000 || !m_by_pc[pc])
+      return nullptr;
+    const chip8_block* block = m_by_pc[pc];
+    if (m_stale[pc]) {
+      if (std::memcmp(memory + block->start, block->bytes,
+                      block->end - block->start) != 0)
+        return nullptr;
+      m_stale[pc] = false;
+    }
+    return block;
+  }
+
+  //Called for every store into memory
+  void invalidate(unsigned first, unsigned count) {
+    if (m_pages.touches(first, count))
+      mark_stale(first, count);
+  }
+
+ private:
+  void unload();
+  void mark_stale(unsigned first, unsigned count);
+
+  void* m_library = nullptr;
+  const chip8_plugin* m_plugin = nullptr;
+  std::vector<const chip8_block*> m_by_pc =
+      std::vector<const chip8_block*>(0x1000);  // block starting at each PC
+  //Blocks to compare with memory before running them. All of them are
+  //after loading, the memory may not hold the ROM yet.
+  std::vector<bool> m_stale = std::vector<bool>(0x1000);
+  code_pages m_pages;
+  unsigned m_longest = 0;  // bytes in the longest block
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "debugger.h"
+#include <cstdio>
+#include "chip8.h"
+#include "disasm.h"
+#include "imgui.h"
+
+namespace {
+
+const ImVec4 pc_color(1.0f, 0.85f, 0.3f, 1.0f);
+const ImVec4 watch_color(1.0f, 0.4f, 0.4f, 1.0f);
+
+unsigned word_at(const chip8_state& s, unsigned address) {
+  return s.memory[address & 0xFFF] << 8 | s.memory[(address + 1) & 0xFFF];
+}
+
+}  // namespace
+
+void debugger::show(chip8& machine, bool visible) {
+  m_visible = visible;
+  if (visible) {
+    machine.set_breakpoints(&m_points);
+  } else {
+    //Without the window nobody could resume, so let the program run
+    machine.set_breakpoints(nullptr);
+    if (machine.is_halted())
+      machine.resume();
+  }
+}
+
+void debugger::draw(chip8& machine) {
+  if (!m_visible)
+    return;
+  ImGui::SetNextWindowSize(ImVec2(560, 640), ImGuiCond_FirstUseEver);
+  bool open = true;
+  if (ImGui::Begin("Debugger", &open)) {
+    draw_controls(machine);
+    ImGui::Separator();
+    draw_registers(machine);
+    ImGui::Separator();
+    draw_disassembly(machine);
+    draw_breakpoints();
+    ImGui::Separator();
+    draw_memory(machine);
+  }
+  ImGui::End();
+  if (!open)
+    show(machine, false);
+}
+
+void debugger::draw_controls(chip8& machine) {
+  const bool halted = machine.is_halted();
+  if (halted) {
+    if (ImGui::Button("Continue"))
+      machine.resume();
+  } else if (ImGui::Button("Pause")) {
+    machine.halt();
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Step") && halted)
+    machine.step();
+  ImGui::SameLine();
+  if (halted)
+    ImGui::TextColored(pc_color, "halted at 0x%03X", machine.state().PC);
+  else
+    ImGui::TextUnformatted("running");
+  ImGui::SameLine();
+  ImGui::TextDisabled("cycle %llu", machine.cycle_count());
+}
+
+void debugger::draw_registers(const chip8& machine) {
+  const chip8_state& s = machine.state();
+  for (int i = 0; i < 16; ++i) {
+    ImGui::Text("V%X %02X", i, s.V[i]);
+    if (i % 8 != 7)
+      ImGui::SameLine();
+  }
+  ImGui::Text("I %03X   PC %03X   SP %X   DT %02X   ST %02X", s.I, s.PC,
+              s.sp, s.delay_timer, s.sound_timer);
+  ImGui::TextUnformatted("Stack");
+  for (unsigned i = 0; i < (s.sp & 0xFu); ++i) {
+    ImGui::SameLine();
+    ImGui::Text("%03X", s.stack[i]);
+  }
+  if (s.key_wait) {
+    ImGui::SameLine();
+    ImGui::TextDisabled("  waiting for a key");
+  }
+}
+
+void debugger::draw_disassembly(const chip8& machine) {
+  const chip8_state& s = machine.state();
+  ImGui::TextDisabled("Click an instruction to toggle a breakpoint");
+  ImGui::BeginChild("disassembly", ImVec2(0, 220), true);
+  for (int line = -12; line <= 12; ++line) {
+    const unsigned address = (s.PC + 2 * line) & 0xFFF;
+    const unsigned op = word_at(s, address);
+    char text[64];
+    std::snprintf(text, sizeof(text), "%c %03X  %04X  %s",
+                  m_points.pc(address) ? '*' : ' ', address, op,
+                  disassemble(static_cast<uint16_t>(op)).c_str());
+    ImGui::PushID(line);
+    if (address == s.PC)
+      ImGui::PushStyleColor(ImGuiCol_Text, pc_color);
+    if (ImGui::Selectable(text, m_points.pc(address)))
+      m_points.toggle_pc(address);
+    if (address == s.PC)
+      ImGui::PopStyleColor();
+    ImGui::PopID();
+  }
+  ImGui::EndChild();
+}
+
+void debugger::draw_breakpoints() {
+  ImGui::SetNextItemWidth(60);
+  ImGui::InputScalar("##address", ImGuiDataType_S32, &m_address, nullptr,
+                     nullptr, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+  m_address &= 0xFFF;
+  ImGui::SameLine();
+  if (ImGui::Button("Break at PC"))
+    m_points.toggle_pc(m_address);
+  ImGui::SameLine();
+  if (ImGui::Button("Watch writes"))
+    m_points.toggle_write(m_address);
+  ImGui::SameLine();
+  if (ImGui::Button("Clear all"))
+    m_points.clear();
+
+  //Listing is a scan of the bitmap, 8 KB worth of bits per frame
+  for (unsigned address = 0; address < 4096; ++address) {
+    const bool pc = m_points.pc(address);
+    const bool write = m_points.write(address);
+    if (!pc && !write)
+      continue;
+    char label[32];
+    std::snprintf(label, sizeof(label), "%03X %s%s", address, pc ? "pc " : "",
+                  write ? "write" : "");
+    if (ImGui::SmallButton(label)) {
+      if (pc)
+        m_points.toggle_pc(address);
+      if (write)
+        m_points.toggle_write(address);
+    }
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Click to remove");
+    ImGui::SameLine();
+  }
+  ImGui::NewLine();
+}
+
+void debugger::draw_memory(const chip8& machine) {
+  const chip8_state& s = machine.state();
+  ImGui::TextDisabled("Click a byte to watch writes to it");
+  ImGui::BeginChild("memory", ImVec2(0, 0), true);
+  const float cell = ImGui::CalcTextSize("00").x;
+  ImGuiListClipper clipper;
+  clipper.Begin(4096 / 16);
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+      ImGui::TextDisabled("%03X", row * 16);
+      for (int col = 0; col < 16; ++col) {
+        const unsigned address = row * 16 + col;
+        ImGui::SameLine(0, col == 8 ? cell : -1.0f);
+        char text[8];
+        std::snprintf(text, sizeof(text), "%02X##%03X", s.memory[address],
+                      address);
+        const bool watched = m_points.write(address);
+        const bool pointed = address == s.I || address == s.PC ||
+                             address == ((s.PC + 1) & 0xFFFu);
+        if (watched)
+          ImGui::PushStyleColor(ImGuiCol_Text, watch_color);
+        else if (pointed)
+          ImGui::PushStyleColor(ImGuiCol_Text, pc_color);
+        if (ImGui::Selectable(text, watched, 0, ImVec2(cell, 0)))
+          m_points.toggle_write(address);
+        if (watched || pointed)
+          ImGui::PopStyleColor();
+      }
+    }
+  }
+  ImGui::EndChild();
+}
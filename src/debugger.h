@@ -0,0 +1,34 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "breakpoints.h"
+
+class chip8;
+
+//ImGui debugger: registers, stack and timers, a disassembly around PC, a
+//live hex view of memory, PC and memory-write breakpoints and single
+//stepping. Toggled with F2. Breakpoints are only attached to the machine
+//while the window is open, so a closed debugger costs the interpreter
+//nothing.
+class debugger {
+ public:
+  void toggle(chip8& machine) { show(machine, !m_visible); }
+  void show(chip8& machine, bool visible);
+  bool visible() const { return m_visible; }
+
+  //Builds the window, between gui_begin_frame() and gui_end_frame()
+  void draw(chip8& machine);
+
+ private:
+  void draw_controls(chip8& machine);
+  void draw_registers(const chip8& machine);
+  void draw_disassembly(const chip8& machine);
+  void draw_breakpoints();
+  void draw_memory(const chip8& machine);
+
+  bool m_visible = false;
+  breakpoints m_points;
+  int m_address = 0x200;  // address field of "add breakpoint"
+};
+
+#endif
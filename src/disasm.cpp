@@ -0,0 +1,64 @@
+#include "disasm.h"
+#include <cstdio>
+#include <cstring>
+
+uint16_t operand_bits(const instruction_form& form) {
+  uint16_t bits = 0;
+  for (const char* op = form.operands; *op;) {
+    const std::size_t length = std::strcspn(op, ",");
+    if (length == 1 && *op == 'x')
+      bits |= 0x0F00;
+    else if (length == 1 && *op == 'y')
+      bits |= 0x00F0;
+    else if (length == 1 && *op == 'n')
+      bits |= 0x000F;
+    else if (length == 2 && !std::strncmp(op, "nn", 2))
+      bits |= 0x00FF;
+    else if (length == 3 && !std::strncmp(op, "nnn", 3))
+      bits |= 0x0FFF;
+    op += length;
+    if (*op == ',')
+      ++op;
+  }
+  return bits;
+}
+
+std::string disassemble(uint16_t opcode) {
+  return disassemble(opcode, std::string());
+}
+
+std::string disassemble(uint16_t opcode, const std::string& label) {
+  const instruction_form* form = decode(opcode);
+  char text[32];
+  if (!form) {
+    std::snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+    return text;
+  }
+  std::string result = form->mnemonic;
+  const char* separator = " ";
+  for (const char* op = form->operands; *op;) {
+    const std::size_t length = std::strcspn(op, ",");
+    const std::string name(op, length);
+    if (name == "x")
+      std::snprintf(text, sizeof(text), "V%X", (opcode & 0x0F00) >> 8);
+    else if (name == "y")
+      std::snprintf(text, sizeof(text), "V%X", (opcode & 0x00F0) >> 4);
+    else if (name == "n")
+      std::snprintf(text, sizeof(text), "%u", opcode & 0x000F);
+    else if (name == "nn")
+      std::snprintf(text, sizeof(text), "0x%02X", opcode & 0x00FF);
+    else if (name == "nnn" && label.empty())
+      std::snprintf(text, sizeof(text), "0x%03X", opcode & 0x0FFF);
+    else if (name == "nnn")
+      std::snprintf(text, sizeof(text), "%s", label.c_str());
+    else
+      std::snprintf(text, sizeof(text), "%s", name.c_str());
+    result += separator;
+    result += text;
+    separator = ", ";
+    op += length;
+    if (*op == ',')
+      ++op;
+  }
+  return result;
+}
@@ -0,0 +1,18 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "opcodes.h"
+
+//Bits of the opcode that come from operands rather than the form
+uint16_t operand_bits(const instruction_form& form);
+
+//Formats a single instruction in Cowgod's mnemonics, e.g. "LD V3, 0x1F".
+//Words that aren't valid instructions come out as "DW 0x1234".
+std::string disassemble(uint16_t opcode);
+//Same, with the NNN operand written as label when it isn't empty
+std::string disassemble(uint16_t opcode, const std::string& label);
+
+#endif
@@ -0,0 +1,281 @@
+#include "frame_export.h"
+#include <chrono>
+#include <cstring>
+#include "chip8.h"
+#include "log.h"
+
+namespace {
+
+//CRC-32 of PNG chunks, table built at compile time
+struct crc_table {
+  uint32_t entries[256];
+  constexpr crc_table() : entries() {
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      entries[n] = c;
+    }
+  }
+};
+constexpr crc_table crc{};
+
+uint32_t crc32(const unsigned char* data, std::size_t size,
+               uint32_t c = 0xFFFFFFFFu) {
+  for (std::size_t i = 0; i < size; ++i)
+    c = crc.entries[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+  return c;
+}
+
+uint32_t adler32(const unsigned char* data, std::size_t size) {
+  uint32_t a = 1, b = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return b << 16 | a;
+}
+
+void put32(std::vector<unsigned char>& out, uint32_t v) {
+  out.push_back(static_cast<unsigned char>(v >> 24));
+  out.push_back(static_cast<unsigned char>(v >> 16));
+  out.push_back(static_cast<unsigned char>(v >> 8));
+  out.push_back(static_cast<unsigned char>(v));
+}
+
+void chunk(std::vector<unsigned char>& out, const char* type,
+           const std::vector<unsigned char>& data) {
+  put32(out, static_cast<uint32_t>(data.size()));
+  const std::size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  put32(out, crc32(&out[start], out.size() - start) ^ 0xFFFFFFFFu);
+}
+
+//A printf pattern with a single integer conversion, e.g. frame%05d.png
+bool is_sequence_pattern(const std::string& name) {
+  const std::size_t percent = name.find('%');
+  if (percent == std::string::npos)
+    return false;
+  std::size_t at = percent + 1;
+  while (at < name.size() && name[at] >= '0' && name[at] <= '9')
+    ++at;
+  return at < name.size() && name[at] == 'd' &&
+         name.find('%', at) == std::string::npos;
+}
+
+bool ends_with(const std::string& name, const char* suffix) {
+  const std::size_t length = std::strlen(suffix);
+  return name.size() >= length &&
+         name.compare(name.size() - length, length, suffix) == 0;
+}
+
+}  // namespace
+
+frame_view::frame_view(const frame_view& other) : m_handle(other.m_handle) {
+  if (m_handle.slot)
+    m_handle.slot->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+frame_view& frame_view::operator=(const frame_view& other) {
+  if (this != &other) {
+    if (other.m_handle.slot)
+      other.m_handle.slot->refs.fetch_add(1, std::memory_order_relaxed);
+    reset();
+    m_handle = other.m_handle;
+  }
+  return *this;
+}
+
+frame_handle frame_view::detach() {
+  const frame_handle handle = m_handle;
+  m_handle = {nullptr, 0};
+  return handle;
+}
+
+void frame_view::reset() {
+  //Release pairs with the acquire in free_slot(): the emulation thread only
+  //rewrites the pixels after every reader is done with them
+  if (m_handle.slot)
+    m_handle.slot->refs.fetch_sub(1, std::memory_order_release);
+  m_handle = {nullptr, 0};
+}
+
+void frame_export::remove_sink(frame_sink* sink) {
+  for (std::size_t i = 0; i < m_sinks.size(); ++i) {
+    if (m_sinks[i] == sink) {
+      m_sinks.erase(m_sinks.begin() + i);
+      return;
+    }
+  }
+}
+
+frame_slot* frame_export::free_slot() {
+  for (std::size_t i = 0; i < slot_count; ++i) {
+    frame_slot& slot = m_slots[(m_next + i) % slot_count];
+    if (slot.refs.load(std::memory_order_acquire) == 0) {
+      m_next = (m_next + i + 1) % slot_count;
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+void frame_export::publish(const chip8& machine) {
+  const uint64_t number = m_number++;
+  if (m_sinks.empty())
+    return;
+  frame_slot* slot = m_last;
+  if (!slot || std::memcmp(slot->pixels, machine.gfx, sizeof(slot->pixels))) {
+    slot = free_slot();
+    if (!slot) {
+      ++m_dropped;
+      return;
+    }
+    std::memcpy(slot->pixels, machine.gfx, sizeof(slot->pixels));
+    m_last = slot;
+  }
+  slot->refs.fetch_add(1, std::memory_order_relaxed);
+  const frame_view view(frame_handle{slot, number});
+  for (frame_sink* sink : m_sinks)
+    sink->frame_ready(view);
+}
+
+video_writer::~video_writer() {
+  stop();
+}
+
+bool video_writer::start() {
+  stop();
+  m_failed = false;
+  m_next = 0;
+  m_end = 0;
+  if (is_sequence_pattern(m_file_name)) {
+    m_format = format::png;
+  } else {
+    m_format = ends_with(m_file_name, ".y4m") ? format::y4m : format::raw;
+    m_file = std::fopen(m_file_name.c_str(), "wb");
+    if (!m_file)
+      return false;
+    //Monochrome 4:0:0, ffmpeg and most players take it as grey
+    if (m_format == format::y4m)
+      std::fprintf(m_file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n",
+                   frame_width, frame_height);
+  }
+  m_running = true;
+  m_thread = std::thread([this] {
+    for (;;) {
+      frame_handle handle;
+      if (m_queue.pop(handle)) {
+        write(frame_view(handle));
+        continue;
+      }
+      //Everything queued before stop() is still written
+      if (!m_running)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    //Frames dropped at the very end still count
+    while (m_last && m_next < m_end.load() && encode(m_last.pixels()))
+      ++m_next;
+    m_last.reset();
+  });
+  return true;
+}
+
+void video_writer::stop() {
+  m_running = false;
+  if (m_thread.joinable())
+    m_thread.join();
+  if (m_file) {
+    std::fclose(m_file);
+    m_file = nullptr;
+  }
+}
+
+void video_writer::frame_ready(const frame_view& frame) {
+  if (!m_running)
+    return;
+  m_end.store(frame.number() + 1, std::memory_order_relaxed);
+  const frame_handle handle = frame_view(frame).detach();
+  //Queue full, the writer fills the gap with the frame before
+  if (!m_queue.push(handle))
+    frame_view released(handle);
+}
+
+void video_writer::write(const frame_view& frame) {
+  if (m_last) {
+    while (m_next < frame.number() && encode(m_last.pixels()))
+      ++m_next;
+  }
+  encode(frame.pixels());
+  m_next = frame.number() + 1;
+  m_last = frame;
+}
+
+bool video_writer::encode(const unsigned char* pixels) {
+  if (m_failed)
+    return false;
+  bool ok;
+  if (m_format == format::png) {
+    ok = write_png(pixels);
+  } else {
+    unsigned char grey[frame_width * frame_height];
+    for (int i = 0; i < frame_width * frame_height; ++i)
+      grey[i] = pixels[i] ? 255 : 0;
+    ok = (m_format != format::y4m || std::fputs("FRAME\n", m_file) >= 0) &&
+         std::fwrite(grey, 1, sizeof(grey), m_file) == sizeof(grey);
+  }
+  if (!ok) {
+    m_failed = true;
+    log_write(log_level::error, log_event::video_write_failed, 0, 0,
+              static_cast<uint32_t>(m_written.load()));
+    return false;
+  }
+  m_written.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+//1-bit greyscale with the image data in a single stored deflate block, small
+//enough that no compressor is needed
+bool video_writer::write_png(const unsigned char* pixels) {
+  constexpr int row_bytes = 1 + frame_width / 8;  // filter type, then pixels
+  unsigned char image[row_bytes * frame_height] = {};
+  for (int y = 0; y < frame_height; ++y) {
+    unsigned char* row = &image[y * row_bytes + 1];
+    for (int x = 0; x < frame_width; ++x) {
+      if (pixels[y * frame_width + x])
+        row[x / 8] |= 0x80 >> (x % 8);
+    }
+  }
+
+  std::vector<unsigned char> header;
+  put32(header, frame_width);
+  put32(header, frame_height);
+  header.insert(header.end(), {1, 0, 0, 0, 0});  // depth, grey, deflate, ...
+
+  std::vector<unsigned char> data = {0x78, 0x01, 0x01};  // zlib, final block
+  const uint16_t size = sizeof(image);
+  const uint16_t inverse = static_cast<uint16_t>(~size);
+  data.insert(data.end(), {static_cast<unsigned char>(size),
+                           static_cast<unsigned char>(size >> 8),
+                           static_cast<unsigned char>(inverse),
+                           static_cast<unsigned char>(inverse >> 8)});
+  data.insert(data.end(), image, image + sizeof(image));
+  put32(data, adler32(image, sizeof(image)));
+
+  std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A,
+                                    '\n'};
+  chunk(png, "IHDR", header);
+  chunk(png, "IDAT", data);
+  chunk(png, "IEND", {});
+
+  char name[1024];
+  std::snprintf(name, sizeof(name), m_file_name.c_str(),
+                static_cast<int>(m_written.load()));
+  std::FILE* file = std::fopen(name, "wb");
+  if (!file)
+    return false;
+  const bool ok = std::fwrite(png.data(), 1, png.size(), file) == png.size();
+  return std::fclose(file) == 0 && ok;
+}
@@ -0,0 +1,123 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spsc_queue.h"
+
+class chip8;
+
+constexpr int frame_width = 64;
+constexpr int frame_height = 32;
+
+//One completed display frame. Slots are preallocated by frame_export and
+//only rewritten by the emulation thread once nobody holds them.
+struct frame_slot {
+  unsigned char pixels[frame_width * frame_height];  // 0 or 1, like gfx
+  std::atomic<int> refs{0};
+};
+
+//A reference to a slot in plain form, for passing through lock-free queues.
+//Whoever ends up with it hands it to a frame_view to release it.
+struct frame_handle {
+  frame_slot* slot;
+  uint64_t number;  // frames published before this one
+};
+
+//Read-only view of a completed frame. Copies share the slot, the last one
+//to go hands the slot back to the ring.
+class frame_view {
+ public:
+  frame_view() = default;
+  //Takes over the reference the handle carries
+  explicit frame_view(frame_handle adopted) : m_handle(adopted) {}
+  frame_view(const frame_view& other);
+  frame_view& operator=(const frame_view& other);
+  ~frame_view() { reset(); }
+
+  explicit operator bool() const { return m_handle.slot != nullptr; }
+  const unsigned char* pixels() const { return m_handle.slot->pixels; }
+  uint64_t number() const { return m_handle.number; }
+  //Gives up the reference without releasing it
+  frame_handle detach();
+  void reset();
+
+ private:
+  frame_handle m_handle{nullptr, 0};
+};
+
+//Something that wants every emulated frame. frame_ready() runs on the
+//emulation thread and must not block, keep the view for as long as the
+//pixels are needed.
+class frame_sink {
+ public:
+  virtual ~frame_sink() = default;
+  virtual void frame_ready(const frame_view& frame) = 0;
+};
+
+//Hands each emulated frame to the sinks. The display is copied once into a
+//free slot and every sink shares it, a frame that didn't change shares the
+//previous slot instead. When all slots are still held the frame is dropped
+//rather than waited for. Must outlive every view it handed out.
+class frame_export {
+ public:
+  static constexpr std::size_t slot_count = 32;
+
+  void add_sink(frame_sink* sink) { m_sinks.push_back(sink); }
+  void remove_sink(frame_sink* sink);
+  //Emulation thread, once per emulated frame
+  void publish(const chip8& machine);
+  uint64_t published() const { return m_number; }
+  uint64_t dropped() const { return m_dropped; }
+
+ private:
+  frame_slot* free_slot();
+
+  frame_slot m_slots[slot_count];
+  std::vector<frame_sink*> m_sinks;
+  frame_slot* m_last = nullptr;  // slot of the previous frame
+  std::size_t m_next = 0;        // where the search for a free slot starts
+  uint64_t m_number = 0;
+  uint64_t m_dropped = 0;
+};
+
+//Writes frames from a background thread: a YUV4MPEG2 stream for names
+//ending in .y4m, a PNG sequence for printf patterns such as
+//frames/%05d.png, raw 8-bit grey frames otherwise. Frames lost while the
+//writer was behind are filled in with the one before so the video keeps
+//60 fps.
+class video_writer : public frame_sink {
+ public:
+  explicit video_writer(std::string file_name) : m_file_name(file_name) {}
+  ~video_writer() override;
+  bool start();
+  void stop();
+  void frame_ready(const frame_view& frame) override;
+  //Writer thread's counts, approximate while it runs
+  uint64_t written() const { return m_written.load(); }
+
+ private:
+  enum class format { y4m, png, raw };
+  void write(const frame_view& frame);
+  bool encode(const unsigned char* pixels);
+  bool write_png(const unsigned char* pixels);
+
+  spsc_queue<frame_handle, frame_export::slot_count> m_queue;
+  std::string m_file_name;
+  format m_format = format::raw;
+  std::FILE* m_file = nullptr;
+  std::thread m_thread;
+  std::atomic<bool> m_running{false};
+  std::atomic<uint64_t> m_written{0};
+  std::atomic<uint64_t> m_end{0};  // one past the newest frame offered
+  frame_view m_last;    // writer thread only
+  uint64_t m_next = 0;  // number of the next frame to write
+  bool m_failed = false;
+};
+
+#endif
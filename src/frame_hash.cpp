@@ -0,0 +1,45 @@
+#include "frame_hash.h"
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CHIP8_PACK_SSE2 1
+#endif
+
+void pack_frame(const unsigned char* gfx, uint64_t rows[32]) {
+  for (int y = 0; y < 32; ++y) {
+    const unsigned char* row = gfx + y * 64;
+    uint64_t bits = 0;
+#if CHIP8_PACK_SSE2
+    //16 pixels at a time: lit bytes compare unequal to zero, movemask
+    //gathers one bit per byte
+    const __m128i zero = _mm_setzero_si128();
+    for (int x = 0; x < 64; x += 16) {
+      const __m128i pixels =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+      const unsigned blank = _mm_movemask_epi8(_mm_cmpeq_epi8(pixels, zero));
+      bits |= static_cast<uint64_t>(~blank & 0xFFFF) << x;
+    }
+#else
+    for (int x = 0; x < 64; ++x)
+      bits |= static_cast<uint64_t>(row[x] != 0) << x;
+#endif
+    rows[y] = bits;
+  }
+}
+
+//Each packed row is mixed in with a multiply and rotate, the result gets
+//MurmurHash3's finalizer so every pixel reaches every bit
+uint64_t frame_hash(const unsigned char* gfx) {
+  uint64_t rows[32];
+  pack_frame(gfx, rows);
+  uint64_t h = 0x9E3779B97F4A7C15ull;
+  for (int y = 0; y < 32; ++y) {
+    h ^= rows[y] * 0x87C37B91114253D5ull;
+    h = (h << 31 | h >> 33) * 0x4CF5AD432745937Full;
+  }
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDull;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ull;
+  h ^= h >> 33;
+  return h;
+}
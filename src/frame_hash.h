@@ -0,0 +1,15 @@
+#ifndef FRAME_HASH_H
+#define FRAME_HASH_H
+
+#include <cstdint>
+
+//Display packed one bit per pixel, one word per row, pixel x in bit x.
+void pack_frame(const unsigned char* gfx, uint64_t rows[32]);
+
+//64-bit hash of a display, for comparing screens without storing them.
+//Golden files depend on its exact value: change it only together with
+//frame_hash_version.
+constexpr uint32_t frame_hash_version = 1;
+uint64_t frame_hash(const unsigned char* gfx);
+
+#endif
@@ -0,0 +1,51 @@
+#include "gui.h"
+#include "imgui.h"
+#include "imgui_impl_glfw.h"
+#include "imgui_impl_opengl3.h"
+
+namespace {
+bool ready = false;
+}
+
+bool gui_init(GLFWwindow* window) {
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+  ImGui::GetIO().IniFilename = nullptr;  // no imgui.ini next to the ROMs
+  ImGui::StyleColorsDark();
+  //Chains to the callbacks already installed on the window
+  if (!ImGui_ImplGlfw_InitForOpenGL(window, true) ||
+      !ImGui_ImplOpenGL3_Init("#version 330 core")) {
+    ImGui::DestroyContext();
+    return false;
+  }
+  ready = true;
+  return true;
+}
+
+bool gui_ready() {
+  return ready;
+}
+
+void gui_shutdown() {
+  if (!ready)
+    return;
+  ImGui_ImplOpenGL3_Shutdown();
+  ImGui_ImplGlfw_Shutdown();
+  ImGui::DestroyContext();
+  ready = false;
+}
+
+void gui_begin_frame() {
+  if (!ready)
+    return;
+  ImGui_ImplOpenGL3_NewFrame();
+  ImGui_ImplGlfw_NewFrame();
+  ImGui::NewFrame();
+}
+
+void gui_end_frame() {
+  if (!ready)
+    return;
+  ImGui::Render();
+  ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+}
@@ -0,0 +1,17 @@
+#ifndef GUI_H
+#define GUI_H
+
+struct GLFWwindow;
+
+//Dear ImGui on the emulator window. The tool windows (performance overlay,
+//debugger) are built between gui_begin_frame() and gui_end_frame(), which
+//renders them on top of the CHIP8 display. When gui_init() failed there is
+//no ImGui context: the tool windows must stay closed, and begin/end do
+//nothing.
+bool gui_init(GLFWwindow* window);
+bool gui_ready();
+void gui_shutdown();
+void gui_begin_frame();
+void gui_end_frame();
+
+#endif
@@ -0,0 +1,25 @@
+#include "input.h"
+#include <chrono>
+#include "chip8.h"
+
+uint64_t input::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool input::push(unsigned char key, bool pressed) {
+  return m_events.push({now(), static_cast<unsigned char>(key & 0xF), pressed});
+}
+
+void input::drain(chip8& machine) {
+  input_event event;
+  bool drained = false;
+  while (m_events.pop(event)) {
+    machine.key_event(event.key, event.pressed);
+    drained = true;
+  }
+  //Only the newest event matters for latency reporting
+  if (drained)
+    m_last_latency = now() - event.timestamp;
+}
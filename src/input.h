@@ -0,0 +1,34 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <cstdint>
+#include "spsc_queue.h"
+
+class chip8;
+
+struct input_event {
+  uint64_t timestamp;  // steady clock, nanoseconds
+  unsigned char key;   // CHIP8 key 0x0-0xF
+  bool pressed;
+};
+
+//Key events are produced by the window system callbacks and consumed by the
+//emulation loop between two instructions, so the interpreter never sees the
+//keypad change in the middle of an opcode.
+class input {
+ public:
+  //Producer side, called from the GLFW key callback.
+  bool push(unsigned char key, bool pressed);
+  //Consumer side, applies every pending event to the machine.
+  void drain(chip8& machine);
+  //Time between the newest drained event being queued and being applied.
+  uint64_t last_latency() const { return m_last_latency; }
+
+  static uint64_t now();
+
+ private:
+  spsc_queue<input_event, 256> m_events;
+  uint64_t m_last_latency = 0;
+};
+
+#endif
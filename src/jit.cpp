@@ -0,0 +1,821 @@
+#include "jit.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include "opcodes.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_X64 1
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+//Block code is called as uint32_t code(chip8_state*, const chip8_host*),
+//the result packs the instructions executed in the low half and the block
+//flags in the high half.
+typedef uint32_t (*block_code)(chip8_state*, const chip8_host*);
+
+struct jit::block {
+  block_code code;
+  uint16_t start;
+  uint16_t end;  // one past the last compiled byte
+  uint16_t instructions;
+};
+
+#if CHIP8_JIT_X64
+
+namespace {
+
+//Host registers by encoding
+enum reg : int {
+  rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+  r8, r9, r10, r11, r12, r13, r14, r15,
+};
+
+//Condition codes for jcc, setcc and cmovcc
+enum cond : int { above_equal = 3, equal = 4, not_equal = 5, above = 7 };
+
+//Group 1 arithmetic: opcode of the "r/m32, r32" form and /digit of 81 /n
+enum class alu_op : int { add_, or_, and_, sub_, xor_, cmp_ };
+const unsigned char alu_rm_r[] = {0x01, 0x09, 0x21, 0x29, 0x31, 0x39};
+const unsigned char alu_digit[] = {0, 1, 4, 5, 6, 7};
+
+#if defined(_WIN32)
+const reg arg_regs[] = {rcx, rdx, r8, r9};
+const reg saved_regs[] = {rbx, rbp, rsi, rdi, r12, r13, r14, r15};
+constexpr int frame_size = 40;  // shadow space, keeps rsp 16-byte aligned
+#else
+const reg arg_regs[] = {rdi, rsi, rdx, rcx};
+const reg saved_regs[] = {rbx, rbp, r12, r13, r14, r15};
+constexpr int frame_size = 8;
+#endif
+
+//The state pointer lives in rbx, the host in r13, I in r12 and the V
+//registers in whatever of these is free. rax, rcx and rdx are scratch.
+constexpr reg state_reg = rbx;
+constexpr reg host_reg = r13;
+constexpr reg i_reg = r12;
+const reg v_pool[] = {rbp, r14, r15, rsi, rdi, r8, r9, r10, r11};
+constexpr int v_pool_size = sizeof(v_pool) / sizeof(v_pool[0]);
+
+constexpr int32_t offset_opcode = offsetof(chip8_state, opcode);
+constexpr int32_t offset_v = offsetof(chip8_state, V);
+constexpr int32_t offset_i = offsetof(chip8_state, I);
+constexpr int32_t offset_pc = offsetof(chip8_state, PC);
+constexpr int32_t offset_delay = offsetof(chip8_state, delay_timer);
+constexpr int32_t offset_stack = offsetof(chip8_state, stack);
+constexpr int32_t offset_sp = offsetof(chip8_state, sp);
+constexpr int32_t offset_key = offsetof(chip8_state, key);
+
+//Just the instructions the translator needs, all 32-bit operations unless
+//the name says otherwise. Memory operands are [rbx + disp], with an
+//optional scaled index. The registers are in the first 128 bytes of the
+//state, so most of them take the one-byte displacement.
+class x64_emitter {
+ public:
+  std::vector<unsigned char> code;
+
+  void mov_imm(reg r, uint32_t value) {
+    rex(false, 0, 0, r);
+    byte(0xB8 + (r & 7));
+    dword(value);
+  }
+  void mov(reg dst, reg src) { alu_rr(0x89, dst, src); }
+  void mov64(reg dst, reg src) {
+    rex(true, src, 0, dst);
+    byte(0x89);
+    modrm_rr(src, dst);
+  }
+  void mov_imm64(reg r, uint64_t value) {
+    rex(true, 0, 0, r);
+    byte(0xB8 + (r & 7));
+    dword(static_cast<uint32_t>(value));
+    dword(static_cast<uint32_t>(value >> 32));
+  }
+  void alu(alu_op op, reg dst, reg src) {
+    alu_rr(alu_rm_r[static_cast<int>(op)], dst, src);
+  }
+  void alu_imm(alu_op op, reg dst, uint32_t value) {
+    rex(false, 0, 0, dst);
+    byte(0x81);
+    modrm_rr(alu_digit[static_cast<int>(op)], dst);
+    dword(value);
+  }
+  void shl(reg r, int count) { shift(4, r, count); }
+  void shr(reg r, int count) { shift(5, r, count); }
+  void test(reg a, reg b) { alu_rr(0x85, a, b); }
+  void setcc(cond c, reg r) {
+    rex(false, 0, 0, r, r >= 4);
+    byte(0x0F);
+    byte(0x90 | c);
+    modrm_rr(0, r);
+  }
+  void cmov(cond c, reg dst, reg src) {
+    rex(false, dst, 0, src);
+    byte(0x0F);
+    byte(0x40 | c);
+    modrm_rr(dst, src);
+  }
+
+  //movzx r, byte/word [rbx + disp]
+  void load8(reg r, int32_t disp) { load(0xB6, r, disp); }
+  void load16(reg r, int32_t disp) { load(0xB7, r, disp); }
+  //movzx r, byte [rbx + index + disp] / word [rbx + index * 2 + disp]
+  void load8_indexed(reg r, reg index, int32_t disp) {
+    load_indexed(0xB6, r, index, 0, disp);
+  }
+  void load16_indexed(reg r, reg index, int32_t disp) {
+    load_indexed(0xB7, r, index, 1, disp);
+  }
+  void store8(int32_t disp, reg r) {
+    rex(false, r, 0, state_reg, r >= 4);  // spl..dil need an empty REX
+    byte(0x88);
+    mem(r, disp);
+  }
+  void store16(int32_t disp, reg r) {
+    byte(0x66);
+    rex(false, r, 0, state_reg);
+    byte(0x89);
+    mem(r, disp);
+  }
+  void store16_indexed(int32_t disp, reg index, reg r) {
+    byte(0x66);
+    rex(false, r, index, state_reg);
+    byte(0x89);
+    mem_indexed(r, index, 1, disp);
+  }
+
+  void push(reg r) {
+    rex(false, 0, 0, r);
+    byte(0x50 + (r & 7));
+  }
+  void pop(reg r) {
+    rex(false, 0, 0, r);
+    byte(0x58 + (r & 7));
+  }
+  void sub_rsp(int8_t amount) { rsp_adjust(5, amount); }
+  void add_rsp(int8_t amount) { rsp_adjust(0, amount); }
+  void call(reg r) {
+    rex(false, 0, 0, r);
+    byte(0xFF);
+    modrm_rr(2, r);
+  }
+  void ret() { byte(0xC3); }
+
+  //Forward jumps, returning the position to patch()
+  std::size_t jcc(cond c) {
+    byte(0x0F);
+    byte(0x80 | c);
+    dword(0);
+    return code.size();
+  }
+  std::size_t jmp() {
+    byte(0xE9);
+    dword(0);
+    return code.size();
+  }
+  //Points the jump ending at position at the current end of the code
+  void patch(std::size_t at) {
+    const uint32_t rel = static_cast<uint32_t>(code.size() - at);
+    std::memcpy(&code[at - 4], &rel, 4);
+  }
+
+ private:
+  void byte(unsigned value) {
+    code.push_back(static_cast<unsigned char>(value));
+  }
+  void dword(uint32_t value) {
+    for (int i = 0; i < 4; ++i)
+      byte(value >> (8 * i));
+  }
+  void rex(bool wide, int r, int index, int base, bool force = false) {
+    const unsigned prefix = 0x40 | wide << 3 | (r >> 3) << 2 |
+                            (index >> 3) << 1 | base >> 3;
+    if (prefix != 0x40 || force)
+      byte(prefix);
+  }
+  void modrm_rr(int r, int rm) { byte(0xC0 | (r & 7) << 3 | (rm & 7)); }
+  void mem(int r, int32_t disp) {
+    byte(mod(disp) | (r & 7) << 3 | state_reg);  // [rbx + disp]
+    displacement(disp);
+  }
+  void mem_indexed(int r, int index, int scale, int32_t disp) {
+    byte(mod(disp) | 0x04 | (r & 7) << 3);  // SIB follows
+    byte(scale << 6 | (index & 7) << 3 | state_reg);
+    displacement(disp);
+  }
+  static bool short_disp(int32_t disp) { return disp >= -128 && disp < 128; }
+  static int mod(int32_t disp) { return short_disp(disp) ? 0x40 : 0x80; }
+  void displacement(int32_t disp) {
+    if (short_disp(disp))
+      byte(static_cast<unsigned char>(disp));
+    else
+      dword(static_cast<uint32_t>(disp));
+  }
+  void alu_rr(unsigned opcode, reg rm, reg r) {
+    rex(false, r, 0, rm);
+    byte(opcode);
+    modrm_rr(r, rm);
+  }
+  void shift(int digit, reg r, int count) {
+    rex(false, 0, 0, r);
+    byte(0xC1);
+    modrm_rr(digit, r);
+    byte(count);
+  }
+  void load(unsigned opcode, reg r, int32_t disp) {
+    rex(false, r, 0, state_reg);
+    byte(0x0F);
+    byte(opcode);
+    mem(r, disp);
+  }
+  void load_indexed(unsigned opcode, reg r, reg index, int scale,
+                    int32_t disp) {
+    rex(false, r, index, state_reg);
+    byte(0x0F);
+    byte(opcode);
+    mem_indexed(r, index, scale, disp);
+  }
+  void rsp_adjust(int digit, int8_t amount) {
+    byte(0x48);
+    byte(0x83);
+    modrm_rr(digit, rsp);
+    byte(static_cast<unsigned char>(amount));
+  }
+};
+
+//Instructions that need loops or the random generator go through these,
+//with every cached register written back first. The stores tell the host
+//what they wrote and report whether it was in their own block, range being
+//start | end << 16, so the block can stop before running instructions it
+//overwrote.
+void helper_clear(chip8_state* s) {
+  std::memset(s->gfx, 0, sizeof(s->gfx));
+}
+
+uint32_t helper_random(const chip8_host* host) {
+  return host->random(host->context);
+}
+
+void helper_draw(chip8_state* s, uint32_t vx, uint32_t vy, uint32_t height) {
+  chip8_draw(*s, vx, vy, height);
+}
+
+uint32_t helper_bcd(chip8_state* s, const chip8_host* host, uint32_t x,
+                    uint32_t range) {
+  chip8_write(*s, s->I, chip8_bcd.digits[s->V[x]], 3);
+  host->stored(host->context, s->I, 3);
+  return chip8_overlaps(s->I, 3, range & 0xFFFF, range >> 16);
+}
+
+uint32_t helper_store(chip8_state* s, const chip8_host* host, uint32_t x,
+                      uint32_t range) {
+  const unsigned first = s->I;
+  chip8_write(*s, first, s->V, x + 1);
+  s->I = static_cast<unsigned short>(first + x + 1);
+  host->stored(host->context, first, x + 1);
+  return chip8_overlaps(first, x + 1, range & 0xFFFF, range >> 16);
+}
+
+void helper_load(chip8_state* s, uint32_t x) {
+  chip8_read(*s, s->I, s->V, x + 1);
+  s->I = static_cast<unsigned short>(s->I + x + 1);
+}
+
+//FX0A waits for the keyboard and FX18's sound edge is timed, the
+//interpreter runs both
+bool translatable(const instruction_form* form) {
+  return form && form->flow != control::stop &&
+         !(form->effects & op_interpreted);
+}
+
+//Translates one block. Guest registers are loaded on first use and stay in
+//host registers until evicted, a helper call or the exit writes them back.
+class translator {
+ public:
+  translator(const unsigned char* memory, unsigned start, unsigned end)
+      : m_memory(memory), m_start(start), m_end(end) {
+    for (int g = 0; g < 16; ++g)
+      m_host[g] = -1;
+    for (int h = 0; h < v_pool_size; ++h)
+      m_guest[h] = -1;
+  }
+
+  std::vector<unsigned char> run() {
+    for (reg r : saved_regs)
+      m_x.push(r);
+    m_x.sub_rsp(frame_size);
+    m_x.mov64(state_reg, arg_regs[0]);
+    m_x.mov64(host_reg, arg_regs[1]);
+
+    unsigned address = m_start;
+    unsigned count = 0;
+    while (address < m_end) {
+      const uint16_t op = m_memory[address] << 8 | m_memory[address + 1];
+      ++count;
+      if (!instruction(*decode(op), op, address, count))
+        break;  // ended the block
+      address += 2;
+    }
+    if (address >= m_end) {
+      m_x.mov_imm(rax, address);
+      exit(count, m_memory[address - 2] << 8 | m_memory[address - 1]);
+    }
+
+    for (std::size_t at : m_exits)
+      m_x.patch(at);
+    m_x.add_rsp(frame_size);
+    for (int i = sizeof(saved_regs) / sizeof(saved_regs[0]) - 1; i >= 0; --i)
+      m_x.pop(saved_regs[i]);
+    m_x.ret();
+    return std::move(m_x.code);
+  }
+
+ private:
+  //Host register holding V[x], loaded from memory unless it is about to be
+  //overwritten
+  reg v(unsigned x, bool load = true) {
+    int slot = m_host[x];
+    if (slot < 0) {
+      slot = 0;
+      for (int h = 0; h < v_pool_size; ++h) {
+        if (m_guest[h] < 0) {
+          slot = h;
+          break;
+        }
+        if (m_used[h] < m_used[slot])
+          slot = h;
+      }
+      if (m_guest[slot] >= 0)
+        spill(m_guest[slot]);
+      m_host[x] = slot;
+      m_guest[slot] = x;
+      if (load)
+        m_x.load8(v_pool[slot], offset_v + x);
+    }
+    m_used[slot] = ++m_clock;
+    return v_pool[slot];
+  }
+  //For instructions that overwrite V[x] or update it in place
+  reg set_v(unsigned x) {
+    const reg r = v(x, false);
+    m_dirty[x] = true;
+    return r;
+  }
+  reg update_v(unsigned x) {
+    const reg r = v(x);
+    m_dirty[x] = true;
+    return r;
+  }
+  reg i(bool load = true) {
+    if (!m_i_cached && load)
+      m_x.load16(i_reg, offset_i);
+    m_i_cached = true;
+    return i_reg;
+  }
+  reg set_i() {
+    i(false);
+    m_i_dirty = true;
+    return i_reg;
+  }
+  void spill(int x) {
+    if (m_dirty[x])
+      m_x.store8(offset_v + x, v_pool[m_host[x]]);
+    m_guest[m_host[x]] = -1;
+    m_host[x] = -1;
+    m_dirty[x] = false;
+  }
+  //Writes back every cached register and forgets them
+  void flush() {
+    for (int x = 0; x < 16; ++x) {
+      if (m_host[x] >= 0)
+        spill(x);
+    }
+    if (m_i_dirty)
+      m_x.store16(offset_i, i_reg);
+    m_i_cached = m_i_dirty = false;
+  }
+
+  void call(void* helper) {
+    m_x.mov_imm64(rax, reinterpret_cast<uint64_t>(helper));
+    m_x.call(rax);
+  }
+
+  //Leaves with the next PC in eax after count instructions, the last one op
+  void exit(unsigned count, unsigned op) {
+    flush();
+    m_x.store16(offset_pc, rax);
+    m_x.mov_imm(rdx, op);
+    m_x.store16(offset_opcode, rdx);
+    m_x.mov_imm(rax, count | static_cast<uint32_t>(m_flags) << 16);
+    m_exits.push_back(m_x.jmp());
+  }
+
+  //PC is address + 4 if the flags say cc, otherwise address + 2
+  void skip_exit(cond cc, unsigned address, unsigned count, unsigned op) {
+    m_x.mov_imm(rax, address + 2);
+    m_x.mov_imm(rcx, address + 4);
+    m_x.cmov(cc, rax, rcx);
+    exit(count, op);
+  }
+
+  //FX33 and FX55 stop the block when they overwrite it, with the helper's
+  //result in eax
+  void exit_if_overwritten(unsigned address, unsigned count, unsigned op) {
+    m_x.test(rax, rax);
+    const std::size_t over = m_x.jcc(equal);
+    m_x.mov_imm(rax, address + 2);
+    exit(count, op);
+    m_x.patch(over);
+  }
+
+  //Emits op, returns false when it ends the block
+  bool instruction(const instruction_form& form, uint16_t op,
+                   unsigned address, unsigned count) {
+    const unsigned x = (op >> 8) & 0xF;
+    const unsigned y = (op >> 4) & 0xF;
+    const unsigned nn = op & 0xFF;
+    const unsigned nnn = op & 0xFFF;
+    switch (form.kind) {
+      case op_kind::cls:
+        flush();
+        m_x.mov64(arg_regs[0], state_reg);
+        call(reinterpret_cast<void*>(&helper_clear));
+        m_flags |= block_drew;
+        return true;
+      case op_kind::ret:
+        m_x.load16(rax, offset_sp);
+        m_x.alu_imm(alu_op::sub_, rax, 1);
+        m_x.alu_imm(alu_op::and_, rax, 0xF);
+        m_x.store16(offset_sp, rax);
+        m_x.load16_indexed(rax, rax, offset_stack);
+        m_x.alu_imm(alu_op::add_, rax, 2);
+        exit(count, op);
+        return false;
+      case op_kind::jp:
+        m_x.mov_imm(rax, nnn);
+        exit(count, op);
+        return false;
+      case op_kind::call:
+        m_x.load16(rax, offset_sp);
+        m_x.alu_imm(alu_op::and_, rax, 0xF);
+        m_x.mov_imm(rdx, address);
+        m_x.store16_indexed(offset_stack, rax, rdx);
+        m_x.alu_imm(alu_op::add_, rax, 1);
+        m_x.alu_imm(alu_op::and_, rax, 0xF);
+        m_x.store16(offset_sp, rax);
+        m_x.mov_imm(rax, nnn);
+        exit(count, op);
+        return false;
+      case op_kind::se_byte:
+      case op_kind::sne_byte:
+        m_x.alu_imm(alu_op::cmp_, v(x), nn);
+        skip_exit(form.kind == op_kind::se_byte ? equal : not_equal, address,
+                  count, op);
+        return false;
+      case op_kind::se_reg:
+      case op_kind::sne_reg: {
+        const reg vx = v(x);
+        m_x.alu(alu_op::cmp_, vx, v(y));
+        skip_exit(form.kind == op_kind::se_reg ? equal : not_equal, address,
+                  count, op);
+        return false;
+      }
+      case op_kind::ld_byte:
+        m_x.mov_imm(set_v(x), nn);
+        return true;
+      case op_kind::add_byte: {
+        const reg vx = update_v(x);
+        m_x.alu_imm(alu_op::add_, vx, nn);
+        m_x.alu_imm(alu_op::and_, vx, 0xFF);
+        return true;
+      }
+      case op_kind::ld_reg:
+      case op_kind::or_reg:
+      case op_kind::and_reg:
+      case op_kind::xor_reg:
+      case op_kind::add_reg:
+      case op_kind::sub_reg:
+      case op_kind::shr:
+      case op_kind::subn_reg:
+      case op_kind::shl:
+        arithmetic(form.kind, x, y);
+        return true;
+      case op_kind::ld_i:
+        m_x.mov_imm(set_i(), nnn);
+        return true;
+      case op_kind::jp_v0:
+        m_x.mov(rax, v(0));
+        m_x.alu_imm(alu_op::add_, rax, nnn);
+        m_x.alu_imm(alu_op::and_, rax, 0xFFFF);
+        exit(count, op);
+        return false;
+      case op_kind::rnd:
+        flush();
+        m_x.mov64(arg_regs[0], host_reg);
+        call(reinterpret_cast<void*>(&helper_random));
+        m_x.alu_imm(alu_op::and_, rax, nn);
+        m_x.mov(set_v(x), rax);
+        return true;
+      case op_kind::drw:
+        flush();
+        m_x.mov64(arg_regs[0], state_reg);
+        m_x.load8(arg_regs[1], offset_v + x);
+        m_x.load8(arg_regs[2], offset_v + y);
+        m_x.mov_imm(arg_regs[3], op & 0xF);
+        call(reinterpret_cast<void*>(&helper_draw));
+        m_flags |= block_drew | block_vblank;
+        return true;
+      case op_kind::skp:
+      case op_kind::sknp:
+        m_x.mov(rax, v(x));
+        m_x.alu_imm(alu_op::and_, rax, 0xF);
+        m_x.load8_indexed(rdx, rax, offset_key);
+        m_x.mov_imm(rcx, form.kind == op_kind::skp ? 1 : 0);
+        m_x.alu(alu_op::cmp_, rdx, rcx);
+        skip_exit(equal, address, count, op);
+        return false;
+      case op_kind::ld_from_dt:
+        m_x.load8(set_v(x), offset_delay);
+        return true;
+      case op_kind::ld_dt:
+        m_x.store8(offset_delay, v(x));
+        return true;
+      case op_kind::add_i:
+        m_x.mov(rax, i());
+        m_x.alu(alu_op::add_, rax, v(x));
+        m_x.alu_imm(alu_op::cmp_, rax, 0xFFF);
+        m_x.mov_imm(rdx, 0);
+        m_x.setcc(above, rdx);
+        m_x.alu_imm(alu_op::and_, rax, 0xFFFF);
+        m_x.mov(set_i(), rax);
+        m_x.mov(set_v(0xF), rdx);
+        return true;
+      case op_kind::ld_font:
+        m_x.mov(rax, v(x));
+        m_x.mov(rdx, rax);
+        m_x.shl(rax, 2);
+        m_x.alu(alu_op::add_, rax, rdx);
+        m_x.mov(set_i(), rax);
+        return true;
+      case op_kind::ld_bcd:
+      case op_kind::ld_store:
+        flush();
+        m_x.mov64(arg_regs[0], state_reg);
+        m_x.mov64(arg_regs[1], host_reg);
+        m_x.mov_imm(arg_regs[2], x);
+        m_x.mov_imm(arg_regs[3], m_start | m_end << 16);
+        call(form.kind == op_kind::ld_bcd
+                 ? reinterpret_cast<void*>(&helper_bcd)
+                 : reinterpret_cast<void*>(&helper_store));
+        exit_if_overwritten(address, count, op);
+        return true;
+      case op_kind::ld_load:
+        flush();
+        m_x.mov64(arg_regs[0], state_reg);
+        m_x.mov_imm(arg_regs[1], x);
+        call(reinterpret_cast<void*>(&helper_load));
+        return true;
+      case op_kind::sys:
+      case op_kind::ld_key:
+      case op_kind::ld_st:
+        break;  // not translatable
+    }
+    return true;
+  }
+
+  //8XYN, VF is written after VX
+  void arithmetic(op_kind kind, unsigned x, unsigned y) {
+    if (kind == op_kind::ld_reg) {
+      const reg vy = v(y);
+      m_x.mov(set_v(x), vy);
+      return;
+    }
+    const reg vx = v(x);
+    switch (kind) {
+      case op_kind::or_reg:
+      case op_kind::and_reg:
+      case op_kind::xor_reg: {
+        const alu_op bitwise = kind == op_kind::or_reg    ? alu_op::or_
+                               : kind == op_kind::and_reg ? alu_op::and_
+                                                          : alu_op::xor_;
+        const reg vy = v(y);
+        m_x.alu(bitwise, update_v(x), vy);
+        return;
+      }
+      case op_kind::add_reg:
+        m_x.mov(rax, vx);
+        m_x.alu(alu_op::add_, rax, v(y));
+        m_x.mov(rdx, rax);
+        m_x.shr(rdx, 8);
+        m_x.alu_imm(alu_op::and_, rax, 0xFF);
+        break;
+      case op_kind::sub_reg:
+      case op_kind::subn_reg: {
+        const reg vy = v(y);
+        const reg minuend = kind == op_kind::sub_reg ? vx : vy;
+        const reg subtrahend = kind == op_kind::sub_reg ? vy : vx;
+        m_x.mov_imm(rdx, 0);
+        m_x.alu(alu_op::cmp_, minuend, subtrahend);
+        m_x.setcc(above_equal, rdx);
+        m_x.mov(rax, minuend);
+        m_x.alu(alu_op::sub_, rax, subtrahend);
+        m_x.alu_imm(alu_op::and_, rax, 0xFF);
+      } break;
+      case op_kind::shr:
+        m_x.mov(rdx, vx);
+        m_x.alu_imm(alu_op::and_, rdx, 1);
+        m_x.mov(rax, vx);
+        m_x.shr(rax, 1);
+        break;
+      default:  // SHL
+        m_x.mov(rdx, vx);
+        m_x.shr(rdx, 7);
+        m_x.mov(rax, vx);
+        m_x.shl(rax, 1);
+        m_x.alu_imm(alu_op::and_, rax, 0xFF);
+        break;
+    }
+    m_x.mov(set_v(x), rax);
+    m_x.mov(set_v(0xF), rdx);
+  }
+
+  x64_emitter m_x;
+  const unsigned char* m_memory;
+  unsigned m_start;
+  unsigned m_end;
+  int m_host[16];              // slot in v_pool holding V[x], or -1
+  bool m_dirty[16] = {};       // V[x] changed since it was loaded
+  int m_guest[v_pool_size];    // V register in each slot, or -1
+  unsigned m_used[v_pool_size] = {};
+  unsigned m_clock = 0;
+  bool m_i_cached = false;
+  bool m_i_dirty = false;
+  uint16_t m_flags = 0;
+  std::vector<std::size_t> m_exits;  // jumps to the epilogue
+};
+
+//Code memory is mapped writable while blocks are copied in and executable
+//otherwise, never both
+unsigned char* map_arena(std::size_t size) {
+#if defined(_WIN32)
+  return static_cast<unsigned char*>(
+      VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return memory == MAP_FAILED ? nullptr : static_cast<unsigned char*>(memory);
+#endif
+}
+
+bool protect_arena(unsigned char* arena, std::size_t size, bool executable) {
+#if defined(_WIN32)
+  DWORD old;
+  if (!VirtualProtect(arena, size,
+                      executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &old))
+    return false;
+  if (executable)
+    FlushInstructionCache(GetCurrentProcess(), arena, size);
+  return true;
+#else
+  const int access =
+      executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE;
+  return mprotect(arena, size, access) == 0;
+#endif
+}
+
+void unmap_arena(unsigned char* arena, std::size_t size) {
+#if defined(_WIN32)
+  (void)size;
+  VirtualFree(arena, 0, MEM_RELEASE);
+#else
+  munmap(arena, size);
+#endif
+}
+
+}  // namespace
+
+bool jit::supported() {
+  return true;
+}
+
+jit::jit() {
+  m_arena = map_arena(arena_size);
+  if (m_arena && !protect_arena(m_arena, arena_size, true)) {
+    unmap_arena(m_arena, arena_size);
+    m_arena = nullptr;
+  }
+  if (!m_arena)
+    std::fill(m_hits.begin(), m_hits.end(), threshold);
+}
+
+jit::~jit() {
+  if (m_arena)
+    unmap_arena(m_arena, arena_size);
+}
+
+jit::block* jit::compile(const chip8_state& s, unsigned pc) {
+  if (!m_arena)
+    return nullptr;
+  //Straight-line code from pc up to the first branch, or to the last
+  //instruction before one only the interpreter runs
+  unsigned end = pc;
+  unsigned count = 0;
+  while (count < max_instructions && end + 1 < 0x1000) {
+    const uint16_t op = s.memory[end] << 8 | s.memory[end + 1];
+    const instruction_form* form = decode(op);
+    if (!translatable(form))
+      break;
+    end += 2;
+    ++count;
+    if (form->flow != control::next)
+      break;
+  }
+  //Entering a block costs more than interpreting a single instruction
+  if (count < 2)
+    return nullptr;
+
+  const std::vector<unsigned char> code =
+      translator(s.memory, pc, end).run();
+  if (code.size() > arena_size)
+    return nullptr;
+  if (m_used + code.size() > arena_size)
+    clear();
+  if (!protect_arena(m_arena, arena_size, false))
+    return nullptr;
+  std::memcpy(m_arena + m_used, code.data(), code.size());
+  const bool executable = protect_arena(m_arena, arena_size, true);
+  if (!executable) {
+    //Can't run anything from here on
+    unmap_arena(m_arena, arena_size);
+    m_arena = nullptr;
+    clear();
+    std::fill(m_hits.begin(), m_hits.end(), threshold);
+    return nullptr;
+  }
+
+  std::unique_ptr<block> b(new block());
+  b->code = reinterpret_cast<block_code>(m_arena + m_used);
+  b->start = static_cast<uint16_t>(pc);
+  b->end = static_cast<uint16_t>(end);
+  b->instructions = static_cast<uint16_t>(count);
+  m_pages.mark(pc, end);
+  m_used += (code.size() + 15) & ~std::size_t(15);
+  m_at[pc] = b.get();
+  m_blocks.push_back(std::move(b));
+  return m_blocks.back().get();
+}
+
+#else
+
+bool jit::supported() {
+  return false;
+}
+
+jit::jit() {
+  std::fill(m_hits.begin(), m_hits.end(), threshold);
+}
+
+jit::~jit() {}
+
+jit::block* jit::compile(const chip8_state&, unsigned) {
+  return nullptr;
+}
+
+#endif
+
+chip8_block_result jit::run_at(chip8_state& s, const chip8_host& host,
+                                unsigned pc, int limit) {
+  block* b = m_at[pc];
+  if (!b && (++m_hits[pc] < threshold || !(b = compile(s, pc))))
+    return {0, 0};
+  if (b->instructions > limit)
+    return {0, 0};
+  const uint32_t result = b->code(&s, &host);
+  return {static_cast<uint16_t>(result), static_cast<uint16_t>(result >> 16)};
+}
+
+//Overwritten blocks are compiled again once the new code gets hot. Their
+//machine code stays in the arena, a store may come from the block itself.
+void jit::drop(unsigned first, unsigned count) {
+  code_pages::ranges(first, count, [this](unsigned lo, unsigned hi) {
+    const unsigned reach = 2 * max_instructions;
+    for (unsigned pc = lo > reach ? lo - reach : 0; pc < hi; ++pc) {
+      if (m_at[pc] && m_at[pc]->end > lo) {
+        m_at[pc] = nullptr;
+        m_hits[pc] = 0;
+      }
+    }
+  });
+}
+
+void jit::clear() {
+  m_pages.clear();
+  m_used = 0;
+  m_blocks.clear();
+  std::fill(m_at.begin(), m_at.end(), nullptr);
+  std::fill(m_hits.begin(), m_hits.end(), 0);
+}
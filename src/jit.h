@@ -0,0 +1,68 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "code_pages.h"
+#include "plugin_abi.h"
+
+//Translates hot straight-line runs of CHIP8 code into x86-64 machine code.
+//A block is compiled from memory the first time its start address has been
+//reached threshold times, and runs with the V registers it uses and I held
+//in host registers, written back only where it exits. A store into a
+//block's bytes drops the translation. Anything the
+//translator doesn't handle (FX0A, unknown opcodes) ends a block and is left
+//to emulate_cycle. On other hosts supported() is false and run() never
+//executes anything.
+class jit {
+ public:
+  static constexpr unsigned threshold = 32;  // executions before compiling
+  static constexpr unsigned max_instructions = 64;  // per block
+  static constexpr std::size_t arena_size = std::size_t(1) << 20;
+
+  jit();
+  ~jit();
+  jit(const jit&) = delete;
+  jit& operator=(const jit&) = delete;
+
+  static bool supported();
+  //Runs the block at s.PC if it is compiled and at most limit instructions
+  //long. Returns no instructions when the interpreter has to step instead.
+  chip8_block_result run(chip8_state& s, const chip8_host& host, int limit) {
+    //Cheap way out for code that was found untranslatable
+    const unsigned pc = s.PC;
+    if (pc >= 0x1000 || (!m_at[pc] && m_hits[pc] >= threshold))
+      return {0, 0};
+    return run_at(s, host, pc, limit);
+  }
+  //Called for every store into memory
+  void invalidate(unsigned first, unsigned count) {
+    if (m_pages.touches(first, count))
+      drop(first, count);
+  }
+  //Drops every translation
+  void clear();
+
+  std::size_t block_count() const { return m_blocks.size(); }
+
+ private:
+  struct block;
+
+  chip8_block_result run_at(chip8_state& s, const chip8_host& host,
+                            unsigned pc, int limit);
+  block* compile(const chip8_state& s, unsigned pc);
+  void drop(unsigned first, unsigned count);
+
+  unsigned char* m_arena = nullptr;  // executable, written only in compile()
+  std::size_t m_used = 0;
+  std::vector<std::unique_ptr<block>> m_blocks;
+  std::vector<block*> m_at = std::vector<block*>(0x1000);  // block by address
+  //Executions of each address not compiled yet, threshold once compiling
+  //was tried
+  std::vector<uint16_t> m_hits = std::vector<uint16_t>(0x1000);
+  code_pages m_pages;
+};
+
+#endif
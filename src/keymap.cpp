@@ -0,0 +1,175 @@
+#include "keymap.h"
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "input.h"
+
+namespace {
+
+struct key_name {
+  const char* name;
+  int code;
+};
+
+//Names that can't be derived from a single character. Letters and digits
+//are handled in key_code().
+const key_name named_keys[] = {
+    {"SPACE", GLFW_KEY_SPACE},
+    {"APOSTROPHE", GLFW_KEY_APOSTROPHE},
+    {"COMMA", GLFW_KEY_COMMA},
+    {"MINUS", GLFW_KEY_MINUS},
+    {"PERIOD", GLFW_KEY_PERIOD},
+    {"SLASH", GLFW_KEY_SLASH},
+    {"SEMICOLON", GLFW_KEY_SEMICOLON},
+    {"EQUAL", GLFW_KEY_EQUAL},
+    {"ENTER", GLFW_KEY_ENTER},
+    {"TAB", GLFW_KEY_TAB},
+    {"BACKSPACE", GLFW_KEY_BACKSPACE},
+    {"RIGHT", GLFW_KEY_RIGHT},
+    {"LEFT", GLFW_KEY_LEFT},
+    {"DOWN", GLFW_KEY_DOWN},
+    {"UP", GLFW_KEY_UP},
+    {"KP_DECIMAL", GLFW_KEY_KP_DECIMAL},
+    {"KP_DIVIDE", GLFW_KEY_KP_DIVIDE},
+    {"KP_MULTIPLY", GLFW_KEY_KP_MULTIPLY},
+    {"KP_SUBTRACT", GLFW_KEY_KP_SUBTRACT},
+    {"KP_ADD", GLFW_KEY_KP_ADD},
+    {"KP_ENTER", GLFW_KEY_KP_ENTER},
+};
+
+const key_name gamepad_buttons[] = {
+    {"GAMEPAD_A", GLFW_GAMEPAD_BUTTON_A},
+    {"GAMEPAD_B", GLFW_GAMEPAD_BUTTON_B},
+    {"GAMEPAD_X", GLFW_GAMEPAD_BUTTON_X},
+    {"GAMEPAD_Y", GLFW_GAMEPAD_BUTTON_Y},
+    {"GAMEPAD_LEFT_BUMPER", GLFW_GAMEPAD_BUTTON_LEFT_BUMPER},
+    {"GAMEPAD_RIGHT_BUMPER", GLFW_GAMEPAD_BUTTON_RIGHT_BUMPER},
+    {"GAMEPAD_BACK", GLFW_GAMEPAD_BUTTON_BACK},
+    {"GAMEPAD_START", GLFW_GAMEPAD_BUTTON_START},
+    {"GAMEPAD_GUIDE", GLFW_GAMEPAD_BUTTON_GUIDE},
+    {"GAMEPAD_LEFT_THUMB", GLFW_GAMEPAD_BUTTON_LEFT_THUMB},
+    {"GAMEPAD_RIGHT_THUMB", GLFW_GAMEPAD_BUTTON_RIGHT_THUMB},
+    {"GAMEPAD_DPAD_UP", GLFW_GAMEPAD_BUTTON_DPAD_UP},
+    {"GAMEPAD_DPAD_RIGHT", GLFW_GAMEPAD_BUTTON_DPAD_RIGHT},
+    {"GAMEPAD_DPAD_DOWN", GLFW_GAMEPAD_BUTTON_DPAD_DOWN},
+    {"GAMEPAD_DPAD_LEFT", GLFW_GAMEPAD_BUTTON_DPAD_LEFT},
+};
+
+int key_code(const std::string& name) {
+  if (name.size() == 1 && (std::isupper(name[0]) || std::isdigit(name[0])))
+    return name[0];  // GLFW uses ASCII for letters and digits
+  if (name.size() == 4 && name.compare(0, 3, "KP_") == 0 &&
+      std::isdigit(name[3]))
+    return GLFW_KEY_KP_0 + (name[3] - '0');
+  for (const auto& k : named_keys) {
+    if (name == k.name)
+      return k.code;
+  }
+  return GLFW_KEY_UNKNOWN;
+}
+
+std::string trim(const std::string& s) {
+  const auto begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string::npos)
+    return "";
+  return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+}
+
+}  // namespace
+
+keymap::keymap() {
+  reset();
+}
+
+//Default COSMAC VIP layout on the left side of a QWERTY keyboard
+void keymap::reset() {
+  m_keys.fill(-1);
+  m_buttons.fill(-1);
+  const int layout[16] = {
+      GLFW_KEY_X, GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3,  // 0 1 2 3
+      GLFW_KEY_Q, GLFW_KEY_W, GLFW_KEY_E, GLFW_KEY_A,  // 4 5 6 7
+      GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_Z, GLFW_KEY_C,  // 8 9 A B
+      GLFW_KEY_4, GLFW_KEY_R, GLFW_KEY_F, GLFW_KEY_V,  // C D E F
+  };
+  for (int i = 0; i < 16; ++i)
+    m_keys[layout[i]] = static_cast<signed char>(i);
+}
+
+bool keymap::bind(const std::string& name, int chip8_key) {
+  for (const auto& b : gamepad_buttons) {
+    if (name == b.name) {
+      m_buttons[b.code] = static_cast<signed char>(chip8_key);
+      return true;
+    }
+  }
+  const int code = key_code(name);
+  if (code < 0 || code >= table_size - 1)
+    return false;
+  m_keys[code] = static_cast<signed char>(chip8_key);
+  return true;
+}
+
+bool keymap::load(const std::string& file_name, const std::string& rom_name) {
+  std::ifstream config(file_name);
+  if (!config)
+    return false;
+  parse(config, file_name, rom_name);
+  return true;
+}
+
+void keymap::parse(std::istream& config, const std::string& name,
+                   const std::string& rom_name) {
+  bool active = true;  // entries before the first section are global
+  std::string line;
+  int line_no = 0;
+  while (std::getline(config, line)) {
+    ++line_no;
+    line = trim(line.substr(0, line.find_first_of("#;")));
+    if (line.empty())
+      continue;
+    if (line.front() == '[' && line.back() == ']') {
+      const std::string section = trim(line.substr(1, line.size() - 2));
+      active = section == "default" || section == rom_name;
+      continue;
+    }
+    if (!active)
+      continue;
+
+    const auto eq = line.find('=');
+    std::string key = trim(line.substr(0, eq));
+    for (auto& c : key)
+      c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    const std::string value =
+        eq == std::string::npos ? "" : trim(line.substr(eq + 1));
+    int chip8_key = -1;
+    if (value == "none")
+      chip8_key = -1;
+    else if (value.size() == 1 && std::isxdigit(value[0]))
+      chip8_key = std::stoi(value, nullptr, 16);
+    else
+      key.clear();
+
+    if (key.empty() || !bind(key, chip8_key))
+      std::cerr << name << ":" << line_no << ": invalid key binding\n";
+  }
+}
+
+void keymap::poll_gamepads(input& events) {
+  unsigned short held = 0;
+  GLFWgamepadstate state;
+  for (int jid = GLFW_JOYSTICK_1; jid <= GLFW_JOYSTICK_LAST; ++jid) {
+    if (!glfwJoystickIsGamepad(jid) || !glfwGetGamepadState(jid, &state))
+      continue;
+    for (int b = 0; b <= GLFW_GAMEPAD_BUTTON_LAST; ++b) {
+      if (state.buttons[b] == GLFW_PRESS && m_buttons[b] >= 0)
+        held |= 1 << m_buttons[b];
+    }
+  }
+  const unsigned short changed = held ^ m_pad_keys;
+  for (int k = 0; changed >> k; ++k) {
+    if (changed & (1 << k))
+      events.push(static_cast<unsigned char>(k), (held & (1 << k)) != 0);
+  }
+  m_pad_keys = held;
+}
@@ -0,0 +1,41 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <array>
+#include <istream>
+#include <string>
+#include "GLFW/glfw3.h"
+
+class input;
+
+//Maps GLFW key codes and gamepad buttons to CHIP8 key indices. Bindings are
+//compiled into flat tables so a lookup is a single masked load.
+class keymap {
+ public:
+  static constexpr int table_size = 512;  // > GLFW_KEY_LAST, power of two
+
+  keymap();
+  //Reads bindings from a config file. Entries before any section header and
+  //in a [default] section always apply, a section named after the ROM file
+  //(e.g. [4-flags.ch8]) overrides them for that ROM only.
+  bool load(const std::string& file_name, const std::string& rom_name);
+  //The same from config text, name only labels error messages
+  void parse(std::istream& config, const std::string& name,
+             const std::string& rom_name);
+  void reset();
+  //Returns the CHIP8 key for a GLFW key code, or -1 when unbound.
+  //GLFW_KEY_UNKNOWN (-1) masks to the last entry, which is never bound.
+  int lookup(int glfw_key) const { return m_keys[glfw_key & (table_size - 1)]; }
+  //Reads every connected gamepad and queues press/release events for
+  //bound buttons whose state changed since the last poll.
+  void poll_gamepads(input& events);
+
+ private:
+  bool bind(const std::string& name, int chip8_key);
+
+  std::array<signed char, table_size> m_keys;
+  std::array<signed char, GLFW_GAMEPAD_BUTTON_LAST + 1> m_buttons;
+  unsigned short m_pad_keys = 0;  // CHIP8 keys held through gamepads
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "log.h"
+#include <chrono>
+
+namespace {
+
+const char* const level_names[] = {"debug", "info", "warning", "error"};
+
+const char* const event_names[] = {
+    "unknown opcode",
+    "loaded ROM",
+    "could not open ROM, check for correct filename or file extension",
+    "ROM does not fit in memory",
+    "analyzed ROM",
+    "loaded compiled ROM",
+    "compiled ROM could not be loaded or was built from another ROM",
+    "frame pacing",
+    "frames dropped",
+    "could not write video, recording stopped",
+};
+static_assert(sizeof(event_names) / sizeof(event_names[0]) ==
+                  static_cast<int>(log_event::count),
+              "every log_event needs a name");
+
+uint64_t steady_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+log_sink& logger() {
+  static log_sink sink;
+  return sink;
+}
+
+log_sink::log_sink() {
+  for (std::size_t i = 0; i < ring_size; ++i)
+    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+log_sink::~log_sink() {
+  stop();
+}
+
+void log_sink::start(std::FILE* out, log_level min_level) {
+  stop();
+  m_out = out;
+  m_min_level = min_level;
+  m_running = true;
+  m_thread = std::thread([this] {
+    while (m_running) {
+      if (drain() == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    m_last_summary = 0;  // flush the suppressed counts too
+    drain();
+  });
+}
+
+void log_sink::stop() {
+  m_running = false;
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+bool log_sink::allow(log_event event, uint64_t timestamp) {
+  rate& r = m_rates[static_cast<int>(event)];
+  const uint64_t second = timestamp / 1000000000;
+  uint64_t window = r.window.load(std::memory_order_relaxed);
+  if (window != second &&
+      r.window.compare_exchange_strong(window, second,
+                                       std::memory_order_relaxed))
+    r.count.store(0, std::memory_order_relaxed);
+  if (r.count.fetch_add(1, std::memory_order_relaxed) < events_per_second)
+    return true;
+  r.suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+//Bounded multi-producer queue: each slot carries a sequence number telling
+//producers whether it is free for the current lap of the ring.
+void log_sink::write(log_level level, log_event event, uint16_t pc,
+                     uint16_t opcode, uint32_t value) {
+  const uint64_t timestamp = steady_ns();
+  if (!allow(event, timestamp))
+    return;
+
+  std::size_t pos = m_head.load(std::memory_order_relaxed);
+  slot* s;
+  for (;;) {
+    s = &m_slots[pos & (ring_size - 1)];
+    const std::size_t seq = s->sequence.load(std::memory_order_acquire);
+    const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+    if (diff == 0) {
+      if (m_head.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);  // ring is full
+      return;
+    } else {
+      pos = m_head.load(std::memory_order_relaxed);
+    }
+  }
+  s->record = {timestamp, value, pc, opcode, level, event};
+  s->sequence.store(pos + 1, std::memory_order_release);
+}
+
+std::size_t log_sink::drain() {
+  std::size_t written = 0;
+  std::size_t pos = m_tail.load(std::memory_order_relaxed);
+  for (;;) {
+    slot& s = m_slots[pos & (ring_size - 1)];
+    if (s.sequence.load(std::memory_order_acquire) != pos + 1)
+      break;
+    const log_record record = s.record;
+    s.sequence.store(pos + ring_size, std::memory_order_release);
+    ++pos;
+    if (record.level >= m_min_level) {
+      print(record);
+      ++written;
+    }
+  }
+  m_tail.store(pos, std::memory_order_relaxed);
+
+  //Suppressed counts are summarised at most once per second
+  const uint64_t now = steady_ns();
+  if (now - m_last_summary >= 1000000000) {
+    m_last_summary = now;
+    for (int i = 0; i < static_cast<int>(log_event::count); ++i) {
+      const uint32_t suppressed = m_rates[i].suppressed.exchange(0);
+      if (suppressed) {
+        std::fprintf(m_out, "[warning] %u '%s' messages suppressed\n",
+                     suppressed, event_names[i]);
+        ++written;
+      }
+    }
+  }
+  if (written)
+    std::fflush(m_out);
+  return written;
+}
+
+void log_sink::print(const log_record& record) {
+  std::fprintf(m_out, "[%s] %s", level_names[static_cast<int>(record.level)],
+               event_names[static_cast<int>(record.event)]);
+  switch (record.event) {
+    case log_event::unknown_opcode:
+      std::fprintf(m_out, " pc=0x%03X opcode=0x%04X", record.pc,
+                   record.opcode);
+      break;
+    case log_event::rom_loaded:
+    case log_event::rom_too_large:
+      std::fprintf(m_out, " size=%u", record.value);
+      break;
+    case log_event::rom_analyzed:
+    case log_event::plugin_loaded:
+      std::fprintf(m_out, " blocks=%u", record.value);
+      break;
+    case log_event::frame_late:
+      std::fprintf(m_out, " worst miss=%uus", record.value);
+      break;
+    case log_event::frames_dropped:
+      std::fprintf(m_out, " count=%u", record.value);
+      break;
+    case log_event::video_write_failed:
+      std::fprintf(m_out, " after %u frames", record.value);
+      break;
+    default:
+      break;
+  }
+  std::fputc('\n', m_out);
+}
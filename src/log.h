@@ -0,0 +1,92 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+enum class log_level : unsigned char { debug, info, warning, error };
+
+//Every diagnostic the core can emit. The text lives in the drain thread, the
+//hot path only stores the id and the numeric fields.
+enum class log_event : unsigned char {
+  unknown_opcode,   // pc, opcode
+  rom_loaded,       // value = size in bytes
+  rom_open_failed,  //
+  rom_too_large,    // value = size in bytes
+  rom_analyzed,     // value = basic blocks found
+  plugin_loaded,    // value = compiled blocks
+  plugin_rejected,  //
+  frame_late,       // value = worst deadline miss in the last second, us
+  frames_dropped,   // value = frames skipped in the last second
+  video_write_failed,  // value = frames written before the failure
+  count
+};
+
+struct log_record {
+  uint64_t timestamp;  // steady clock, nanoseconds
+  uint32_t value;
+  uint16_t pc;
+  uint16_t opcode;
+  log_level level;
+  log_event event;
+};
+
+//Lock-free multi-producer log ring drained by a background thread. Producers
+//never block or allocate: when the ring is full or an event exceeds its rate
+//limit the record is dropped and only counted. Without a running drain
+//thread records simply stay in the ring.
+class log_sink {
+ public:
+  static constexpr std::size_t ring_size = 1024;      // power of two
+  static constexpr uint32_t events_per_second = 10;  // per event id
+
+  log_sink();
+  ~log_sink();
+  void start(std::FILE* out = stderr, log_level min_level = log_level::info);
+  void stop();
+
+  void write(log_level level, log_event event, uint16_t pc, uint16_t opcode,
+             uint32_t value);
+  //Formats every pending record, returns how many were written out. Only
+  //one thread may drain at a time.
+  std::size_t drain();
+
+  uint64_t dropped() const { return m_dropped.load(); }
+
+ private:
+  struct slot {
+    std::atomic<std::size_t> sequence;
+    log_record record;
+  };
+  struct rate {
+    std::atomic<uint64_t> window{0};  // second the counter belongs to
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> suppressed{0};
+  };
+
+  bool allow(log_event event, uint64_t timestamp);
+  void print(const log_record& record);
+
+  slot m_slots[ring_size];
+  alignas(64) std::atomic<std::size_t> m_head{0};
+  alignas(64) std::atomic<std::size_t> m_tail{0};
+  rate m_rates[static_cast<int>(log_event::count)];
+  std::atomic<uint64_t> m_dropped{0};
+
+  std::thread m_thread;
+  std::atomic<bool> m_running{false};
+  uint64_t m_last_summary = 0;  // drain thread only
+  std::FILE* m_out = stderr;
+  log_level m_min_level = log_level::info;
+};
+
+log_sink& logger();
+
+inline void log_write(log_level level, log_event event, uint16_t pc = 0,
+                      uint16_t opcode = 0, uint32_t value = 0) {
+  logger().write(level, event, pc, opcode, value);
+}
+
+#endif
@@ -1,6 +1,11 @@
 #include <stdint.h>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
 #include <vector>
 #include "GLFW/glfw3.h"
 #include "glad/glad.h"
@@ -14,8 +19,22 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 
+#include "audio.h"
 #include "chip8.h"
+#include "compiled.h"
+#include "debugger.h"
+#include "embedded_resources.h"
+#include "frame_export.h"
+#include "gui.h"
+#include "input.h"
+#include "jit.h"
+#include "keymap.h"
+#include "log.h"
+#include "overlay.h"
+#include "pacer.h"
+#include "rom_analysis.h"
 #include "shader.h"
+#include "trace.h"
 
 #define SCREEN_WIDTH 64
 #define SCREEN_HEIGHT 32
@@ -34,19 +53,33 @@ __declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
 //end of gpu selection.
 
 chip8 myChip8;
+input keyboard;
+keymap keys;
+audio speaker;
 Shader shader;
+perf_overlay overlay;
+debugger dbg;
 
 struct Vertex {
   float x, y, z;
 };
 
+//The frame_params uniform block of the shaders, std140 layout
+struct frame_params {
+  float foreground[4];
+  float background[4];
+  float scale[4];  // window units to clip space: x and y scale, then offset
+};
+constexpr GLuint frame_params_binding = 0;
+uniform_buffer params_buffer;
+
 // CallBack function for various event handling and helper methods
 void window_size_callback(GLFWwindow* window, int width, int height);
 static void error_callback(int error, const char* description);
 static void keypress_callback(GLFWwindow* window, int key, int scancode,
                               int action, int mods);
 void drawPixel(int x, int y);
-void updateQuads(const chip8& Chip8);
+int updateQuads(const chip8& Chip8);
 void openglInformation();
 
 int main(int argc, char** argv) {
@@ -54,15 +87,89 @@ int main(int argc, char** argv) {
   // Chip8 initializatio
   if (argc < 2) {
     std::cout << "chip8-emulator-cpp.exe uses: \n"
-              << argv[0] << " path/to/chip8/program\n";
+              << argv[0] << " path/to/chip8/program [path/to/keymap.cfg]\n";
     return 1;
   }
+  logger().start();
   myChip8.initialize();
   if (!myChip8.load_game(argv[1])) {
     std::cout << "chip8-emulator-cpp.exe uses: \n"
               << argv[1] << " path/to/chip8/program\n";
     return 1;
   }
+  //Code and data map for precompiling, cached next to the ROM
+  rom_analysis analysis;
+  if (analysis_for(argv[1], analysis))
+    log_write(log_level::info, log_event::rom_analyzed, 0, 0,
+              static_cast<uint32_t>(analysis.blocks.size()));
+  //Compiled ROM, CHIP8_PLUGIN=file or rom.ch8.so next to the ROM
+  compiled_rom aot;
+  const char* plugin_path = std::getenv("CHIP8_PLUGIN");
+  const std::string plugin =
+      plugin_path ? plugin_path
+                  : std::string(argv[1]) + compiled_rom::library_suffix;
+  if (analysis.size && aot.load(plugin, analysis.hash, analysis.size)) {
+    myChip8.set_compiled(&aot);
+    log_write(log_level::info, log_event::plugin_loaded, 0, 0,
+              static_cast<uint32_t>(aot.block_count()));
+  } else if (plugin_path) {
+    log_write(log_level::warning, log_event::plugin_rejected);
+  }
+  //Native code for hot blocks, CHIP8_JIT=1 on x86-64 hosts
+  const char* jit_enabled = std::getenv("CHIP8_JIT");
+  std::unique_ptr<jit> translator;
+  if (jit_enabled && std::atoi(jit_enabled) && jit::supported()) {
+    translator = std::make_unique<jit>();
+    myChip8.set_jit(translator.get());
+  }
+  //Keymap from the second argument, otherwise resources/keymap.cfg as built
+  //in. A section named after the ROM file overrides the defaults.
+  const std::string rom_path = argv[1];
+  const std::string rom_name =
+      rom_path.substr(rom_path.find_last_of("/\\") + 1);
+  if (argc > 2) {
+    if (!keys.load(argv[2], rom_name)) {
+      std::cout << "Could not open keymap " << argv[2] << "\n";
+      return 1;
+    }
+  } else if (const char* builtin = embedded_resource_text("keymap.cfg")) {
+    std::istringstream config(builtin);
+    keys.parse(config, "keymap.cfg", rom_name);
+  } else {
+    std::cout << "No built-in keymap, using the default layout\n";
+  }
+  //Audio, CHIP8_AUDIO_WAV=file.wav records the beeper instead of discarding it
+  const char* wav_path = std::getenv("CHIP8_AUDIO_WAV");
+  if (wav_path)
+    speaker.start(std::make_unique<wav_sink>(wav_path));
+  else
+    speaker.start(std::make_unique<null_sink>());
+  myChip8.set_sound_listener(&speaker);
+
+  //Execution trace, CHIP8_TRACE=file.bin keeps the most recent instructions
+  const char* trace_path = std::getenv("CHIP8_TRACE");
+  std::unique_ptr<trace_recorder> tracer;
+  if (trace_path) {
+    tracer = std::make_unique<trace_recorder>();
+    myChip8.set_trace(tracer.get());
+  }
+
+  //Video, CHIP8_VIDEO=file.y4m or frames/%05d.png records every frame
+  frame_export exporter;
+  const char* video_path = std::getenv("CHIP8_VIDEO");
+  std::unique_ptr<video_writer> recorder;
+  if (video_path) {
+    recorder = std::make_unique<video_writer>(video_path);
+    if (recorder->start())
+      exporter.add_sink(recorder.get());
+    else
+      std::cout << "Could not write video " << video_path << "\n";
+  }
+
+  //Speed, CHIP8_IPF=N runs N instructions per frame, 0 uses VIP timing
+  if (const char* ipf = std::getenv("CHIP8_IPF"))
+    myChip8.set_speed(std::atoi(ipf));
+
   //Error Callback function for use
   glfwSetErrorCallback(error_callback);
 
@@ -96,27 +203,85 @@ int main(int argc, char** argv) {
     std::cout << "Failed to initialize OpenGL context" << std::endl;
     return -1;
   }
-  shader.loadShaders("../resources/shader.vert", "../resources/shader.frag");
+  //Shaders are built in. CHIP8_SHADER_DIR=../resources loads them from
+  //there instead, and edits to the files show up while running.
+  const char* shader_dir = std::getenv("CHIP8_SHADER_DIR");
+  if (shader_dir) {
+    const std::string dir = shader_dir;
+    shader.loadShaders((dir + "/shader.vert").c_str(),
+                       (dir + "/shader.frag").c_str());
+  } else {
+    shader.loadEmbedded("shader.vert", "shader.frag");
+  }
   //Video Card Information
   //This call must be after the context is set and also after all function from glad are loaded
   openglInformation();
-  shader.compileShader();
+  //Linked program cached across starts, CHIP8_SHADER_CACHE= disables it
+  const char* shader_cache = std::getenv("CHIP8_SHADER_CACHE");
+  shader.compileShader(shader_cache ? shader_cache : "chip8-shader.cache");
+  shader.bindUniformBlock("frame_params", frame_params_binding);
+  const frame_params params = {
+      {0.5f, 0.3f, 0.0f, 1.0f},
+      {0.2f, 0.3f, 0.3f, 1.0f},
+      {2.0f / (SCREEN_WIDTH * 10), -2.0f / (SCREEN_HEIGHT * 10), -1.0f, 1.0f}};
+  params_buffer.create(frame_params_binding, sizeof(params));
+  params_buffer.update(&params, sizeof(params));
+  //After the key callback is installed, ImGui chains to it
+  if (!gui_init(window))
+    std::cout << "Could not initialize the overlay and debugger\n";
+
+  //Emulation runs at 60 Hz whatever the display refresh rate is
+  frame_pacer pacer(std::chrono::microseconds(chip8::frame_time));
 
   // Main loop
   while (!glfwWindowShouldClose(window)) {
-    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    const int frames = pacer.wait();
+    glfwPollEvents();
+    keys.poll_gamepads(keyboard);
+    frame_timing timing;
+    auto start = std::chrono::steady_clock::now();
+    auto lap = [&start] {
+      const auto now = std::chrono::steady_clock::now();
+      const float ms =
+          std::chrono::duration<float, std::milli>(now - start).count();
+      start = now;
+      return ms;
+    };
+    for (int i = 0; i < frames; ++i) {
+      myChip8.run_frame(&keyboard);
+      exporter.publish(myChip8);
+    }
+    speaker.update();
+    timing.emulate = lap();
+    if (shader_dir && shader.reloadIfChanged())
+      shader.bindUniformBlock("frame_params", frame_params_binding);
+    glClearColor(params.background[0], params.background[1],
+                 params.background[2], params.background[3]);
     glClear(GL_COLOR_BUFFER_BIT);
-    myChip8.emulate_cycle();
-    if (myChip8.drawFlag == true) {
-      updateQuads(myChip8);
-      myChip8.drawFlag = false;
-      glfwSwapBuffers(window);
+    const int draw_calls = updateQuads(myChip8);
+    myChip8.drawFlag = false;
+    if (overlay.visible() || dbg.visible()) {
+      gui_begin_frame();
+      overlay.draw(pacer.stats(), speaker);
+      dbg.draw(myChip8);
+      gui_end_frame();
     }
-    glfwPollEvents();
+    timing.render = lap();
+    glfwSwapBuffers(window);
+    timing.swap = lap();
+    overlay.record(timing, myChip8.cycle_count(), draw_calls);
   }
 
+  gui_shutdown();
+  params_buffer.destroy();
+  speaker.stop();
+  if (recorder)
+    recorder->stop();
+  if (tracer && !tracer->save(trace_path))
+    std::cout << "Could not write trace " << trace_path << "\n";
   glfwDestroyWindow(window);
   glfwTerminate();
+  logger().stop();
 
   return 0;
 }
@@ -127,82 +292,30 @@ void window_size_callback(GLFWwindow* window, int width, int height) {
 }
 
 // graphics api(OpenGL) keyprocessing
+// Key events are only queued here, the emulation loop applies them
 static void keypress_callback(GLFWwindow* window, int key, int scancode,
                               int action, int mods) {
-  if (action == GLFW_PRESS) {
-    switch (key) {
-      case GLFW_KEY_ESCAPE:
-        glfwSetWindowShouldClose(window, GLFW_TRUE);
-        break;
-
-      case GLFW_KEY_1:
-        myChip8.key[0x1] = 0;
-        break;
-
-      case GLFW_KEY_2:
-        myChip8.key[0x2] = 0;
-        break;
-
-      case GLFW_KEY_3:
-        myChip8.key[0x3] = 0;
-        break;
-
-      case GLFW_KEY_4:
-        myChip8.key[0xC] = 0;
-        break;
-
-      case GLFW_KEY_Q:
-        myChip8.key[0x4] = 0;
-        break;
-
-      case GLFW_KEY_W:
-        myChip8.key[0x5] = 0;
-        break;
-
-      case GLFW_KEY_E:
-        myChip8.key[0x6] = 0;
-        break;
-
-      case GLFW_KEY_R:
-        myChip8.key[0xD] = 0;
-        break;
-
-      case GLFW_KEY_A:
-        myChip8.key[0x7] = 0;
-        break;
-
-      case GLFW_KEY_S:
-        myChip8.key[0x8] = 0;
-        break;
-
-      case GLFW_KEY_D:
-        myChip8.key[0x9] = 0;
-        break;
-
-      case GLFW_KEY_F:
-        myChip8.key[0xE] = 0;
-        break;
-
-      case GLFW_KEY_Z:
-        myChip8.key[0xA] = 0;
-        break;
-
-      case GLFW_KEY_X:
-        myChip8.key[0x0] = 0;
-        break;
-
-      case GLFW_KEY_C:
-        myChip8.key[0xB] = 0;
-        break;
-
-      case GLFW_KEY_V:
-        myChip8.key[0xF] = 0;
-        break;
-
-      default:
-        break;
-    }
+  if (action == GLFW_REPEAT)
+    return;
+  //The tool windows need ImGui, without it F1 and F2 do nothing
+  if (key == GLFW_KEY_F1) {
+    if (action == GLFW_PRESS && gui_ready())
+      overlay.toggle();
+    return;
+  }
+  if (key == GLFW_KEY_F2) {
+    if (action == GLFW_PRESS && gui_ready())
+      dbg.toggle(myChip8);
+    return;
   }
+  if (key == GLFW_KEY_ESCAPE) {
+    if (action == GLFW_PRESS)
+      glfwSetWindowShouldClose(window, GLFW_TRUE);
+    return;
+  }
+  const int chip8_key = keys.lookup(key);
+  if (chip8_key >= 0)
+    keyboard.push(chip8_key, action == GLFW_PRESS);
 }
 
 void drawPixel(int x, int y) {
@@ -214,11 +327,7 @@ void drawPixel(int x, int y) {
       glm::vec3((x * 10.0) + 10.0f, (y * 10.0f), 0.0f);          //bottom right
   vertices[2] = glm::vec3((x * 10.0), (y * 10.0f), 0.0f);        //bottom left
   vertices[3] = glm::vec3((x * 10.0), (y * 10.0) + 10.0, 0.0f);  //top left
-  //Orthogonal projection for window coordinate
-  glm::mat4 projection = glm::ortho(0.0f, SCREEN_WIDTH * 10.0f,
-                                    SCREEN_HEIGHT * 10.0f, 0.0f, -1.0f, 1.0f);
-  for (auto& vertex : vertices)
-    vertex = glm::vec3(projection * glm::vec4(vertex, 1.0f));
+  //The vertex shader projects window coordinates with frame_params.scale
   unsigned int indices[] = {
       // note that we start from 0!
       0, 1, 3,  // first Triangle
@@ -246,16 +355,25 @@ void drawPixel(int x, int y) {
   shader.use();
   glBindVertexArray(VAO);
   glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  glBindVertexArray(0);
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
 }
 
-void updateQuads(const chip8& Chip8) {
+//Returns the number of draw calls issued
+int updateQuads(const chip8& Chip8) {
+  int draw_calls = 0;
   // cycle through VRAM and draw every pixel
   for (unsigned int y = 0; y < 32; y++) {
     for (unsigned int x = 0; x < 64; x++) {
-      if (Chip8.gfx[x + (y * 64)])
+      if (Chip8.gfx[x + (y * 64)]) {
         drawPixel(x, y);
+        ++draw_calls;
+      }
     }
   }
+  return draw_calls;
 }
 
 //Video Card Information
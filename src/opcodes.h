@@ -0,0 +1,179 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <cstddef>
+#include <cstdint>
+
+//How an instruction hands on control, for following code through a ROM.
+enum class control : unsigned char {
+  next,      // falls through
+  skip,      // falls through or skips the next instruction
+  jump,      // 1NNN
+  call,      // 2NNN
+  ret,       // 00EE
+  indirect,  // BNNN, the target depends on V0
+  stop,      // 0NNN, the interpreter doesn't execute machine code
+};
+
+//What an instruction does. The interpreter and the translators switch on
+//this instead of taking the opcode apart again.
+enum class op_kind : unsigned char {
+  cls, ret, sys, jp, call, se_byte, sne_byte, se_reg, ld_byte, add_byte,
+  ld_reg, or_reg, and_reg, xor_reg, add_reg, sub_reg, shr, subn_reg, shl,
+  sne_reg, ld_i, jp_v0, rnd, drw, skp, sknp, ld_from_dt, ld_key, ld_dt,
+  ld_st, add_i, ld_font, ld_bcd, ld_store, ld_load,
+};
+
+//Effects besides PC, for tracing, analysis and picking fast paths
+constexpr uint16_t op_writes_vx = 1;       // VX, for FX65 V0..VX
+constexpr uint16_t op_writes_vf = 2;       // the flag register
+constexpr uint16_t op_sets_i = 4;
+constexpr uint16_t op_reads_memory = 8;    // at I
+constexpr uint16_t op_writes_memory = 16;  // at I
+constexpr uint16_t op_draws = 32;          // changes gfx
+constexpr uint16_t op_random = 64;
+constexpr uint16_t op_waits = 128;         // FX0A stalls until a key is released
+constexpr uint16_t op_sounds = 256;        // FX18 may start or stop the beeper
+//Left to the interpreter by both translators: FX0A's wait, and FX18 so
+//every sound edge is stamped with the instruction it happened on
+constexpr uint16_t op_interpreted = op_waits | op_sounds;
+
+//One row of the instruction table shared by the interpreter, the
+//disassembler, the assembler, the code map, the ROM analysis and both
+//translators. An opcode is the first row with (opcode & mask) == match.
+//Operands are comma separated: x and y are the registers in the X and Y
+//nibbles, n, nn and nnn the immediates, anything else (I, DT, V0, ...) is
+//written literally.
+struct instruction_form {
+  uint16_t mask;
+  uint16_t match;
+  const char* mnemonic;
+  const char* operands;
+  control flow;
+  op_kind kind;
+  //Approximate COSMAC VIP execution time in microseconds, from T. Jackson's
+  //measurements of the original interpreter. DXYN has none: the VIP waits
+  //for the display interrupt before drawing, so a draw ends the frame.
+  uint16_t vip_cost;
+  uint16_t effects;
+};
+
+inline constexpr instruction_form instruction_table[] = {
+    {0xFFFF, 0x00E0, "CLS", "", control::next, op_kind::cls, 109, op_draws},
+    {0xFFFF, 0x00EE, "RET", "", control::ret, op_kind::ret, 105, 0},
+    {0xF000, 0x0000, "SYS", "nnn", control::stop, op_kind::sys, 105, 0},
+    {0xF000, 0x1000, "JP", "nnn", control::jump, op_kind::jp, 105, 0},
+    {0xF000, 0x2000, "CALL", "nnn", control::call, op_kind::call, 105, 0},
+    {0xF000, 0x3000, "SE", "x,nn", control::skip, op_kind::se_byte, 55, 0},
+    {0xF000, 0x4000, "SNE", "x,nn", control::skip, op_kind::sne_byte, 55, 0},
+    //The low nibble of 5XY0 and 9XY0 is ignored, like the interpreter does
+    {0xF000, 0x5000, "SE", "x,y", control::skip, op_kind::se_reg, 73, 0},
+    {0xF000, 0x6000, "LD", "x,nn", control::next, op_kind::ld_byte, 27,
+     op_writes_vx},
+    {0xF000, 0x7000, "ADD", "x,nn", control::next, op_kind::add_byte, 45,
+     op_writes_vx},
+    {0xF00F, 0x8000, "LD", "x,y", control::next, op_kind::ld_reg, 200,
+     op_writes_vx},
+    {0xF00F, 0x8001, "OR", "x,y", control::next, op_kind::or_reg, 200,
+     op_writes_vx},
+    {0xF00F, 0x8002, "AND", "x,y", control::next, op_kind::and_reg, 200,
+     op_writes_vx},
+    {0xF00F, 0x8003, "XOR", "x,y", control::next, op_kind::xor_reg, 200,
+     op_writes_vx},
+    {0xF00F, 0x8004, "ADD", "x,y", control::next, op_kind::add_reg, 200,
+     op_writes_vx | op_writes_vf},
+    {0xF00F, 0x8005, "SUB", "x,y", control::next, op_kind::sub_reg, 200,
+     op_writes_vx | op_writes_vf},
+    //Shifts use VX only, VY is kept in the listing when a ROM sets it
+    {0xF0FF, 0x8006, "SHR", "x", control::next, op_kind::shr, 200,
+     op_writes_vx | op_writes_vf},
+    {0xF00F, 0x8006, "SHR", "x,y", control::next, op_kind::shr, 200,
+     op_writes_vx | op_writes_vf},
+    {0xF00F, 0x8007, "SUBN", "x,y", control::next, op_kind::subn_reg, 200,
+     op_writes_vx | op_writes_vf},
+    {0xF0FF, 0x800E, "SHL", "x", control::next, op_kind::shl, 200,
+     op_writes_vx | op_writes_vf},
+    {0xF00F, 0x800E, "SHL", "x,y", control::next, op_kind::shl, 200,
+     op_writes_vx | op_writes_vf},
+    {0xF000, 0x9000, "SNE", "x,y", control::skip, op_kind::sne_reg, 73, 0},
+    {0xF000, 0xA000, "LD", "I,nnn", control::next, op_kind::ld_i, 55,
+     op_sets_i},
+    {0xF000, 0xB000, "JP", "V0,nnn", control::indirect, op_kind::jp_v0, 105,
+     0},
+    {0xF000, 0xC000, "RND", "x,nn", control::next, op_kind::rnd, 164,
+     op_writes_vx | op_random},
+    {0xF000, 0xD000, "DRW", "x,y,n", control::next, op_kind::drw, 0,
+     op_writes_vf | op_reads_memory | op_draws},
+    {0xF0FF, 0xE09E, "SKP", "x", control::skip, op_kind::skp, 73, 0},
+    {0xF0FF, 0xE0A1, "SKNP", "x", control::skip, op_kind::sknp, 73, 0},
+    {0xF0FF, 0xF007, "LD", "x,DT", control::next, op_kind::ld_from_dt, 45,
+     op_writes_vx},
+    {0xF0FF, 0xF00A, "LD", "x,K", control::next, op_kind::ld_key, 45,
+     op_writes_vx | op_waits},
+    {0xF0FF, 0xF015, "LD", "DT,x", control::next, op_kind::ld_dt, 45, 0},
+    {0xF0FF, 0xF018, "LD", "ST,x", control::next, op_kind::ld_st, 45,
+     op_sounds},
+    {0xF0FF, 0xF01E, "ADD", "I,x", control::next, op_kind::add_i, 86,
+     op_writes_vf | op_sets_i},
+    {0xF0FF, 0xF029, "LD", "F,x", control::next, op_kind::ld_font, 91,
+     op_sets_i},
+    {0xF0FF, 0xF033, "LD", "B,x", control::next, op_kind::ld_bcd, 927,
+     op_writes_memory},
+    {0xF0FF, 0xF055, "LD", "[I],x", control::next, op_kind::ld_store, 605,
+     op_sets_i | op_writes_memory},
+    {0xF0FF, 0xF065, "LD", "x,[I]", control::next, op_kind::ld_load, 605,
+     op_writes_vx | op_sets_i | op_reads_memory},
+};
+constexpr std::size_t instruction_table_size =
+    sizeof(instruction_table) / sizeof(instruction_table[0]);
+
+//Row of the table for every top nibble and low byte, built at compile time.
+//Only 0x0 opcodes depend on the X nibble (00E0 and 00EE against SYS),
+//decode() checks the row it finds and searches the table when it doesn't
+//match.
+struct decode_index {
+  static constexpr uint8_t none = 0xFF;
+  uint8_t row[16 * 256];
+
+  static constexpr unsigned key(uint16_t opcode) {
+    return (opcode >> 12) << 8 | (opcode & 0xFF);
+  }
+  constexpr decode_index() : row() {
+    for (unsigned k = 0; k < 16 * 256; ++k) {
+      const unsigned opcode = (k >> 8) << 12 | (k & 0xFF);
+      row[k] = none;
+      for (std::size_t i = 0; i < instruction_table_size; ++i) {
+        if ((opcode & instruction_table[i].mask) == instruction_table[i].match) {
+          row[k] = static_cast<uint8_t>(i);
+          break;
+        }
+      }
+    }
+  }
+};
+inline constexpr decode_index instruction_index{};
+
+constexpr const instruction_form* decode_slow(uint16_t opcode) {
+  for (std::size_t i = 0; i < instruction_table_size; ++i) {
+    if ((opcode & instruction_table[i].mask) == instruction_table[i].match)
+      return &instruction_table[i];
+  }
+  return nullptr;
+}
+
+//nullptr for words that aren't instructions
+constexpr const instruction_form* decode(uint16_t opcode) {
+  const uint8_t row = instruction_index.row[decode_index::key(opcode)];
+  if (row != decode_index::none &&
+      (opcode & instruction_table[row].mask) == instruction_table[row].match)
+    return &instruction_table[row];
+  return decode_slow(opcode);
+}
+
+static_assert(decode(0x00E0)->kind == op_kind::cls, "decode index");
+static_assert(decode(0x01E0)->kind == op_kind::sys, "decode index");
+static_assert(decode(0x8A16)->kind == op_kind::shr, "decode index");
+static_assert(decode(0xF00A)->effects & op_waits, "decode index");
+static_assert(decode(0x800F) == nullptr, "decode index");
+
+#endif
@@ -0,0 +1,67 @@
+#include "overlay.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include "audio.h"
+#include "imgui.h"
+#include "input.h"
+#include "pacer.h"
+
+void perf_overlay::record(const frame_timing& timing,
+                          unsigned long long cycles, int draw_calls) {
+  const uint64_t now = input::now();
+  std::rotate(std::begin(m_frame_ms), std::begin(m_frame_ms) + 1,
+              std::end(m_frame_ms));
+  m_frame_ms[history - 1] = m_last_record ? (now - m_last_record) / 1e6f : 0;
+  m_last_record = now;
+  m_last = timing;
+  m_draw_calls = draw_calls;
+
+  if (m_window_start == 0) {
+    m_window_start = now;
+    m_window_cycles = cycles;
+  } else if (now - m_window_start >= 500000000) {
+    m_ips = (cycles - m_window_cycles) * 1e9 / (now - m_window_start);
+    m_window_start = now;
+    m_window_cycles = cycles;
+  }
+}
+
+void perf_overlay::draw(const frame_stats& pacing, const audio& speaker) {
+  if (!m_visible)
+    return;
+  ImGui::SetNextWindowPos(ImVec2(8, 8), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowBgAlpha(0.8f);
+  ImGui::Begin("Performance", &m_visible,
+               ImGuiWindowFlags_AlwaysAutoResize |
+                   ImGuiWindowFlags_NoFocusOnAppearing);
+  ImGui::Text("Emulation   %.0f instructions/s", m_ips);
+  ImGui::Text("Frame       %.2f ms, jitter %.2f ms, worst miss %.2f ms",
+              pacing.frame_ms, pacing.jitter_ms, pacing.late_ms);
+  ImGui::Text("Catch-up    %llu doubled, %llu dropped",
+              static_cast<unsigned long long>(pacing.doubled),
+              static_cast<unsigned long long>(pacing.dropped));
+
+  const float worst =
+      *std::max_element(std::begin(m_frame_ms), std::end(m_frame_ms));
+  ImGui::PlotHistogram("##frames", m_frame_ms, history, 0, "host frame ms",
+                       0.0f, std::max(33.4f, worst), ImVec2(360, 80));
+
+  ImGui::Text("Emulate     %.2f ms", m_last.emulate);
+  ImGui::Text("Render      %.2f ms, %d draw calls", m_last.render,
+              m_draw_calls);
+  ImGui::Text("Swap        %.2f ms", m_last.swap);
+
+  const float fill =
+      static_cast<float>(speaker.buffered()) / audio::ring_size;
+  char label[48];
+  std::snprintf(label, sizeof(label), "%zu samples, %.1f ms",
+                speaker.buffered(),
+                speaker.buffered() * 1000.0 / audio::sample_rate);
+  ImGui::Text("Audio");
+  ImGui::SameLine();
+  ImGui::ProgressBar(fill, ImVec2(240, 0), label);
+  ImGui::Text("Underruns   %llu",
+              static_cast<unsigned long long>(speaker.underruns()));
+  ImGui::End();
+}
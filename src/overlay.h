@@ -0,0 +1,46 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <cstdint>
+
+struct frame_stats;
+class audio;
+
+//Where the host spent one frame, in milliseconds.
+struct frame_timing {
+  float emulate = 0;
+  float render = 0;
+  float swap = 0;
+};
+
+//ImGui window with the numbers needed to diagnose stutter: emulated
+//instructions per second, a host frame time history, the emulate / render /
+//swap split, draw calls and audio buffer fill. Toggled with F1, costs
+//nothing but the bookkeeping in record() while hidden.
+class perf_overlay {
+ public:
+  static constexpr int history = 240;  // frames kept for the plot
+
+  void toggle() { m_visible = !m_visible; }
+  bool visible() const { return m_visible; }
+
+  //Once per host frame, cycles is chip8::cycle_count()
+  void record(const frame_timing& timing, unsigned long long cycles,
+              int draw_calls);
+  //Builds the window, between gui_begin_frame() and gui_end_frame()
+  void draw(const frame_stats& pacing, const audio& speaker);
+
+ private:
+  bool m_visible = false;
+  float m_frame_ms[history] = {};  // time between host frames, oldest first
+  uint64_t m_last_record = 0;      // steady clock ns
+  frame_timing m_last;
+  int m_draw_calls = 0;
+
+  //Instructions per second, measured over half a second
+  uint64_t m_window_start = 0;  // steady clock ns
+  unsigned long long m_window_cycles = 0;
+  double m_ips = 0;
+};
+
+#endif
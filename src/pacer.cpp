@@ -0,0 +1,88 @@
+#include "pacer.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include "log.h"
+
+frame_pacer::frame_pacer(std::chrono::microseconds period)
+    : m_period(period),
+      m_deadline(clock::now() + period),
+      m_last_frame(clock::now()),
+      m_oversleep(std::chrono::milliseconds(1)),
+      m_window_start(m_last_frame) {}
+
+int frame_pacer::wait() {
+  const clock::time_point due = m_deadline;
+  sleep_until(due);
+  const clock::time_point now = clock::now();
+  const clock::duration late = now - due;
+
+  //Frames whose deadline has passed as well, run them now
+  int frames = 1 + static_cast<int>(late / m_period);
+  if (frames > max_catch_up) {
+    //Too far behind (debugger, window dragged, ...), don't try to catch up
+    m_window_dropped += frames - max_catch_up;
+    m_stats.dropped += frames - max_catch_up;
+    frames = max_catch_up;
+    m_deadline = now + m_period;
+  } else {
+    m_deadline += frames * m_period;
+  }
+  m_stats.doubled += frames - 1;
+  account(now, late);
+  return frames;
+}
+
+void frame_pacer::sleep_until(clock::time_point deadline) {
+  using std::chrono::microseconds;
+  //Sleep while the deadline is further away than the OS tends to oversleep
+  const clock::duration margin = m_oversleep + microseconds(200);
+  clock::time_point now = clock::now();
+  if (deadline - now > margin) {
+    const clock::duration request = deadline - now - margin;
+    std::this_thread::sleep_for(request);
+    const clock::time_point woke = clock::now();
+    //Moving average of the overshoot, rises quickly and decays slowly
+    const clock::duration over =
+        std::max(clock::duration(0), woke - now - request);
+    if (over > m_oversleep)
+      m_oversleep = (m_oversleep + over) / 2;
+    else
+      m_oversleep = (m_oversleep * 15 + over) / 16;
+    now = woke;
+  }
+  while (now < deadline) {
+    std::this_thread::yield();
+    now = clock::now();
+  }
+}
+
+void frame_pacer::account(clock::time_point now, clock::duration late) {
+  using ms = std::chrono::duration<double, std::milli>;
+  const double frame = ms(now - m_last_frame).count();
+  m_last_frame = now;
+  ++m_frames;
+  m_sum += frame;
+  m_sum_sq += frame * frame;
+  m_worst_late = std::max(m_worst_late, late);
+  if (now - m_window_start < std::chrono::seconds(1))
+    return;
+
+  const double mean = m_sum / m_frames;
+  m_stats.frame_ms = mean;
+  m_stats.jitter_ms = std::sqrt(std::max(0.0, m_sum_sq / m_frames - mean * mean));
+  m_stats.late_ms = ms(m_worst_late).count();
+  const auto late_us = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(m_worst_late)
+          .count());
+  log_write(log_level::debug, log_event::frame_late, 0, 0, late_us);
+  if (m_window_dropped)
+    log_write(log_level::warning, log_event::frames_dropped, 0, 0,
+              static_cast<uint32_t>(m_window_dropped));
+
+  m_window_start = now;
+  m_frames = 0;
+  m_sum = m_sum_sq = 0;
+  m_worst_late = clock::duration(0);
+  m_window_dropped = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <chrono>
+#include <cstdint>
+
+struct frame_stats {
+  double frame_ms = 0;     // mean time between frames
+  double jitter_ms = 0;    // standard deviation of the frame time
+  double late_ms = 0;      // worst deadline miss
+  uint64_t doubled = 0;    // frames run twice to catch up
+  uint64_t dropped = 0;    // frames given up on after a long stall
+};
+
+//Keeps the emulation at 60 Hz on a monotonic clock, independent of the
+//display. wait() sleeps most of the way to the next deadline and spins the
+//rest, the sleep margin follows how much the OS has been oversleeping so the
+//deadline is normally hit within half a millisecond. On a display faster
+//than 60 Hz some refreshes get no emulated frame, when the host falls behind
+//the missed frames are run back to back, up to max_catch_up.
+class frame_pacer {
+ public:
+  using clock = std::chrono::steady_clock;
+  static constexpr int max_catch_up = 4;
+
+  explicit frame_pacer(std::chrono::microseconds period);
+
+  //Blocks until the next frame is due, returns how many frames to run.
+  int wait();
+  //Stats over the last completed second
+  const frame_stats& stats() const { return m_stats; }
+
+ private:
+  void sleep_until(clock::time_point deadline);
+  void account(clock::time_point now, clock::duration late);
+
+  clock::duration m_period;
+  clock::time_point m_deadline;
+  clock::time_point m_last_frame;
+  clock::duration m_oversleep;  // running estimate of sleep_for overshoot
+
+  //Current one second window
+  clock::time_point m_window_start;
+  uint64_t m_frames = 0;
+  double m_sum = 0;
+  double m_sum_sq = 0;
+  clock::duration m_worst_late{0};
+  uint64_t m_window_dropped = 0;
+  frame_stats m_stats;
+};
+
+#endif
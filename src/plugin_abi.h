@@ -0,0 +1,123 @@
+#ifndef PLUGIN_ABI_H
+#define PLUGIN_ABI_H
+
+#include <cstdint>
+#include <cstring>
+#include "chip8.h"
+
+//Interface between the emulator and ROMs compiled ahead of time by
+//chip8-recompile. The generated source is built against this header into a
+//shared library that compiled_rom loads. Bump the version whenever this
+//header or chip8_state changes.
+constexpr uint32_t chip8_plugin_version = 4;
+
+//Services the emulator lends to compiled code
+struct chip8_host {
+  //CXNN draws from the machine's generator
+  unsigned char (*random)(void* context);
+  //Every FX33/FX55 store, so code cached over the written bytes is dropped
+  void (*stored)(void* context, unsigned first, unsigned count);
+  void* context;  // passed to both
+};
+
+//Result flags of a block
+constexpr uint16_t block_drew = 1;    // 00E0 or DXYN changed gfx
+constexpr uint16_t block_vblank = 2;  // DXYN, the VIP waits for the display
+
+struct chip8_block_result {
+  uint16_t instructions;  // executed, may be fewer than the block holds
+  uint16_t flags;
+};
+
+//A run of straight-line code ending in a branch or at a point only the
+//interpreter can handle. run() leaves the machine exactly as executing the
+//same instructions with emulate_cycle would.
+struct chip8_block {
+  uint16_t start;
+  uint16_t end;                // one past the last compiled byte
+  uint16_t instructions;
+  const unsigned char* bytes;  // ROM bytes the block was compiled from
+  chip8_block_result (*run)(chip8_state& s, const chip8_host& host);
+};
+
+struct chip8_plugin {
+  uint32_t version;
+  uint64_t rom_hash;  // rom_hash() of the ROM it was compiled from
+  uint32_t rom_size;
+  uint32_t block_count;
+  const chip8_block* blocks;
+};
+
+//The one symbol a plugin exports
+#define CHIP8_PLUGIN_ENTRY "chip8_plugin_entry"
+typedef const chip8_plugin* (*chip8_plugin_entry_fn)();
+#if defined(_WIN32)
+#define CHIP8_PLUGIN_EXPORT extern "C" __declspec(dllexport)
+#else
+#define CHIP8_PLUGIN_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+//DXYN the way chip8::emulate_cycle draws it
+inline void chip8_draw(chip8_state& s, unsigned vx, unsigned vy,
+                       unsigned height) {
+  unsigned char column[8];
+  for (unsigned col = 0; col < 8; ++col)
+    column[col] = (vx + col) & 63;
+  s.V[0xF] = 0;
+  for (unsigned line = 0; line < height; ++line) {
+    const unsigned char bits = s.memory[(s.I + line) & 0xFFF];
+    unsigned char* row = &s.gfx[((vy + line) & 31) * 64];
+    for (unsigned col = 0; col < 8; ++col) {
+      if (bits & (0x80 >> col)) {
+        if (row[column[col]])
+          s.V[0xF] = 1;
+        row[column[col]] ^= 1;
+      }
+    }
+  }
+}
+
+//FX33's hundreds, tens and ones digits of every byte value, built at
+//compile time
+struct chip8_bcd_table {
+  unsigned char digits[256][3];
+  constexpr chip8_bcd_table() : digits() {
+    for (unsigned v = 0; v < 256; ++v) {
+      digits[v][0] = static_cast<unsigned char>(v / 100);
+      digits[v][1] = static_cast<unsigned char>(v / 10 % 10);
+      digits[v][2] = static_cast<unsigned char>(v % 10);
+    }
+  }
+};
+inline constexpr chip8_bcd_table chip8_bcd{};
+
+//Block copies between memory from first and a buffer for FX33, FX55 and
+//FX65, count at most 16. A run past 0xFFF wraps to 0x000 like every other
+//memory access, as two memcpy calls.
+inline void chip8_write(chip8_state& s, unsigned first,
+                        const unsigned char* data, unsigned count) {
+  first &= 0xFFF;
+  const unsigned head = count < 0x1000 - first ? count : 0x1000 - first;
+  std::memcpy(s.memory + first, data, head);
+  std::memcpy(s.memory, data + head, count - head);
+}
+inline void chip8_read(const chip8_state& s, unsigned first,
+                       unsigned char* data, unsigned count) {
+  first &= 0xFFF;
+  const unsigned head = count < 0x1000 - first ? count : 0x1000 - first;
+  std::memcpy(data, s.memory + first, head);
+  std::memcpy(data + head, s.memory, count - head);
+}
+
+//Whether count bytes written from first land in [start, end)
+inline bool chip8_overlaps(unsigned first, unsigned count, unsigned start,
+                           unsigned end) {
+  for (unsigned i = 0; i < count; ++i) {
+    const unsigned address = (first + i) & 0xFFF;
+    if (address >= start && address < end)
+      return true;
+  }
+  return false;
+}
+
+#endif
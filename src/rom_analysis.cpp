@@ -0,0 +1,321 @@
+#include "rom_analysis.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include "code_map.h"
+#include "disasm.h"
+
+namespace {
+
+constexpr int format_version = 1;
+constexpr unsigned origin = 0x200;
+
+//Value of I at some point: a constant, or one of these
+constexpr int undefined = -2;  // not reached yet
+constexpr int unknown = -1;    // differs between paths or computed
+
+int meet(int a, int b) {
+  if (a == undefined)
+    return b;
+  if (b == undefined)
+    return a;
+  return a == b ? a : unknown;
+}
+
+struct block_info {
+  uint16_t start;
+  uint16_t end;
+  control flow;     // of the last instruction
+  uint16_t target;  // its NNN
+};
+
+struct edge {
+  uint16_t to;
+  bool keeps_i;  // false across a call, the callee may change I
+};
+
+std::vector<edge> successors(const block_info& b, bool into_calls) {
+  switch (b.flow) {
+    case control::next:
+      return {{b.end, true}};
+    case control::skip:
+      return {{b.end, true}, {static_cast<uint16_t>(b.end + 2), true}};
+    case control::jump:
+    case control::indirect:
+      return {{b.target, true}};
+    case control::call:
+      if (into_calls)
+        return {{b.target, true}, {b.end, false}};
+      return {{b.end, false}};
+    case control::ret:
+    case control::stop:
+      break;
+  }
+  return {};
+}
+
+//Runs a block over the value of I at its start, reporting memory writes
+template <class Write>
+int transfer(const unsigned char* rom, const block_info& b, int i,
+             Write&& write) {
+  for (unsigned address = b.start; address < b.end; address += 2) {
+    const uint16_t opcode = rom[address - origin] << 8 |
+                            rom[address - origin + 1];
+    const unsigned x = (opcode & 0x0F00) >> 8;
+    const instruction_form* form = decode(opcode);
+    if (!form || !(form->effects & (op_sets_i | op_writes_memory)))
+      continue;
+    switch (form->kind) {
+      case op_kind::ld_i:
+        i = opcode & 0x0FFF;
+        break;
+      case op_kind::ld_bcd:
+        write(i, 3u);
+        break;
+      case op_kind::ld_store:
+        write(i, x + 1);
+        if (i >= 0)
+          i += x + 1;
+        break;
+      case op_kind::ld_load:
+        if (i >= 0)
+          i += x + 1;
+        break;
+      default:
+        //FX1E and FX29 depend on a register
+        i = unknown;
+    }
+  }
+  return i;
+}
+
+}  // namespace
+
+uint64_t rom_hash(const unsigned char* rom, std::size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (std::size_t i = 0; i < size; ++i) {
+    hash ^= rom[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+rom_analysis analyze_rom(const unsigned char* rom, std::size_t size) {
+  rom_analysis result;
+  result.hash = rom_hash(rom, size);
+  result.size = size;
+  const code_map map = map_code(rom, size, origin);
+  result.indirect = map.indirect;
+
+  //Extent of every block: up to the next leader or control transfer
+  std::vector<block_info> blocks;
+  for (uint16_t start : map.blocks) {
+    block_info b{start, start, control::stop, 0};
+    for (unsigned address = start;;) {
+      const uint16_t opcode = rom[address - origin] << 8 |
+                              rom[address - origin + 1];
+      const instruction_form* form = decode(opcode);
+      address += 2;
+      b.end = static_cast<uint16_t>(address);
+      b.target = opcode & 0x0FFF;
+      b.flow = form ? form->flow : control::stop;
+      if (b.flow != control::next)
+        break;
+      if (address + 1 >= origin + size ||
+          map.kind[address - origin] != byte_opcode ||
+          std::binary_search(map.blocks.begin(), map.blocks.end(), address))
+        break;
+    }
+    blocks.push_back(b);
+  }
+  auto block_at = [&](uint16_t address) -> int {
+    const auto it = std::lower_bound(
+        blocks.begin(), blocks.end(), address,
+        [](const block_info& b, uint16_t a) { return b.start < a; });
+    return it != blocks.end() && it->start == address
+               ? static_cast<int>(it - blocks.begin())
+               : -1;
+  };
+
+  //I at the start of every block, I is 0 when the program starts
+  std::vector<int> i_in(blocks.size(), undefined);
+  std::vector<int> pending;
+  if (!blocks.empty()) {
+    i_in[0] = 0;
+    pending.push_back(0);
+  }
+  auto ignore = [](int, unsigned) {};
+  while (!pending.empty()) {
+    const int b = pending.back();
+    pending.pop_back();
+    const int i_out = transfer(rom, blocks[b], i_in[b], ignore);
+    for (const edge& e : successors(blocks[b], true)) {
+      const int s = block_at(e.to);
+      if (s < 0)
+        continue;
+      const int merged = meet(i_in[s], e.keeps_i ? i_out : unknown);
+      if (merged != i_in[s]) {
+        i_in[s] = merged;
+        pending.push_back(s);
+      }
+    }
+  }
+
+  for (std::size_t b = 0; b < blocks.size(); ++b) {
+    const int i = i_in[b] == undefined ? unknown : i_in[b];
+    transfer(rom, blocks[b], i, [&](int first, unsigned count) {
+      if (first < 0) {
+        ++result.unresolved_writes;
+        return;
+      }
+      write_range w{static_cast<uint16_t>(first),
+                    static_cast<uint16_t>(first + count), false};
+      for (unsigned a = w.first; a < w.end; ++a) {
+        if (a >= origin && a < origin + size && map.kind[a - origin] != byte_data)
+          w.hits_code = true;
+      }
+      result.writes.push_back(w);
+    });
+  }
+  std::sort(result.writes.begin(), result.writes.end(),
+            [](const write_range& a, const write_range& b) {
+              return a.first != b.first ? a.first < b.first : a.end < b.end;
+            });
+  result.writes.erase(
+      std::unique(result.writes.begin(), result.writes.end(),
+                  [](const write_range& a, const write_range& b) {
+                    return a.first == b.first && a.end == b.end;
+                  }),
+      result.writes.end());
+
+  for (const block_info& b : blocks) {
+    basic_block block{b.start, b.end, false};
+    for (const write_range& w : result.writes) {
+      if (w.first < b.end && w.end > b.start)
+        block.self_modifying = true;
+    }
+    result.blocks.push_back(block);
+  }
+
+  //Subroutines: blocks reachable from each call target, stepping over calls
+  std::vector<uint16_t> entries;
+  for (const block_info& b : blocks) {
+    if (b.flow == control::call)
+      entries.push_back(b.target);
+  }
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+  for (uint16_t entry : entries) {
+    const int first = block_at(entry);
+    if (first < 0)
+      continue;
+    subroutine sub{entry, blocks[first].end, false};
+    std::vector<bool> seen(blocks.size(), false);
+    std::vector<int> walk{first};
+    seen[first] = true;
+    while (!walk.empty()) {
+      const block_info& b = blocks[walk.back()];
+      walk.pop_back();
+      sub.end = std::max(sub.end, b.end);
+      if (b.flow == control::ret)
+        sub.returns = true;
+      for (const edge& e : successors(b, false)) {
+        const int s = block_at(e.to);
+        if (s >= 0 && !seen[s]) {
+          seen[s] = true;
+          walk.push_back(s);
+        }
+      }
+    }
+    result.subroutines.push_back(sub);
+  }
+  return result;
+}
+
+bool save_analysis(const std::string& file_name, const rom_analysis& result) {
+  std::ofstream out(file_name);
+  if (!out)
+    return false;
+  char line[64];
+  std::snprintf(line, sizeof(line), "rom %016llx %zu\n",
+                static_cast<unsigned long long>(result.hash), result.size);
+  out << "chip8-analysis " << format_version << "\n" << line;
+  out << "flags " << result.indirect << " " << result.unresolved_writes
+      << "\n";
+  for (const basic_block& b : result.blocks) {
+    std::snprintf(line, sizeof(line), "block 0x%03X 0x%03X %d\n", b.start,
+                  b.end, b.self_modifying);
+    out << line;
+  }
+  for (const subroutine& s : result.subroutines) {
+    std::snprintf(line, sizeof(line), "sub 0x%03X 0x%03X %d\n", s.entry,
+                  s.end, s.returns);
+    out << line;
+  }
+  for (const write_range& w : result.writes) {
+    std::snprintf(line, sizeof(line), "write 0x%03X 0x%03X %d\n", w.first,
+                  w.end, w.hits_code);
+    out << line;
+  }
+  return static_cast<bool>(out);
+}
+
+bool load_analysis(const std::string& file_name, const unsigned char* rom,
+                   std::size_t size, rom_analysis& result) {
+  std::ifstream in(file_name);
+  std::string kind;
+  int version = 0;
+  if (!(in >> kind >> version) || kind != "chip8-analysis" ||
+      version != format_version)
+    return false;
+
+  rom_analysis loaded;
+  std::string text;
+  while (std::getline(in, text)) {
+    std::istringstream fields(text);
+    std::string field, a, b, c;
+    fields >> field >> a >> b >> c;
+    const unsigned long first = std::strtoul(a.c_str(), nullptr, 0);
+    const unsigned long second = std::strtoul(b.c_str(), nullptr, 0);
+    const bool flag = c == "1";
+    if (field == "rom") {
+      loaded.hash = std::strtoull(a.c_str(), nullptr, 16);
+      loaded.size = second;
+    } else if (field == "flags") {
+      loaded.indirect = a == "1";
+      loaded.unresolved_writes = static_cast<unsigned>(second);
+    } else if (field == "block") {
+      loaded.blocks.push_back({static_cast<uint16_t>(first),
+                               static_cast<uint16_t>(second), flag});
+    } else if (field == "sub") {
+      loaded.subroutines.push_back({static_cast<uint16_t>(first),
+                                    static_cast<uint16_t>(second), flag});
+    } else if (field == "write") {
+      loaded.writes.push_back({static_cast<uint16_t>(first),
+                               static_cast<uint16_t>(second), flag});
+    }
+  }
+  //A stale cache is as good as none
+  if (loaded.size != size || loaded.hash != rom_hash(rom, size))
+    return false;
+  result = std::move(loaded);
+  return true;
+}
+
+bool analysis_for(const std::string& rom_file, rom_analysis& result) {
+  std::ifstream file(rom_file, std::ios::binary);
+  const std::vector<unsigned char> rom((std::istreambuf_iterator<char>(file)),
+                                       std::istreambuf_iterator<char>());
+  if (!file || rom.empty() || rom.size() > 4096 - origin)
+    return false;
+  const std::string cache = rom_file + ".analysis";
+  if (load_analysis(cache, rom.data(), rom.size(), result))
+    return true;
+  result = analyze_rom(rom.data(), rom.size());
+  //A read-only ROM directory only costs the analysis on the next start
+  save_analysis(cache, result);
+  return true;
+}
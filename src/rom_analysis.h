@@ -0,0 +1,56 @@
+#ifndef ROM_ANALYSIS_H
+#define ROM_ANALYSIS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct basic_block {
+  uint16_t start;
+  uint16_t end;                 // one past the last instruction
+  bool self_modifying = false;  // a known FX33/FX55 write lands in it
+};
+
+//Code reachable from a 2NNN target without following further calls
+struct subroutine {
+  uint16_t entry;
+  uint16_t end;  // one past its highest instruction
+  bool returns;  // reaches an 00EE
+};
+
+//Memory written by an FX33 or FX55 whose I is known statically
+struct write_range {
+  uint16_t first;
+  uint16_t end;
+  bool hits_code;
+};
+
+//What can be known about a ROM before running it. Blocks that are not
+//self-modifying are safe to precompile, as long as unresolved_writes is 0
+//or the engine still checks writes at run time.
+struct rom_analysis {
+  uint64_t hash = 0;  // rom_hash(), identifies the cache entry
+  std::size_t size = 0;
+  std::vector<basic_block> blocks;
+  std::vector<subroutine> subroutines;
+  std::vector<write_range> writes;
+  unsigned unresolved_writes = 0;  // FX33/FX55 with an unknown I
+  bool indirect = false;           // BNNN seen, some code may be missing
+};
+
+//FNV-1a of the ROM bytes, identifies caches and compiled code
+uint64_t rom_hash(const unsigned char* rom, std::size_t size);
+rom_analysis analyze_rom(const unsigned char* rom, std::size_t size);
+
+//The cache is a small text file. Loading fails when it is missing, written
+//by another version or made for different ROM contents.
+bool save_analysis(const std::string& file_name, const rom_analysis& result);
+bool load_analysis(const std::string& file_name, const unsigned char* rom,
+                   std::size_t size, rom_analysis& result);
+
+//Analysis of the ROM in rom_file, from rom_file + ".analysis" when that is
+//current, otherwise computed and written there.
+bool analysis_for(const std::string& rom_file, rom_analysis& result);
+
+#endif
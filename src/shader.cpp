@@ -1,4 +1,5 @@
 #include "shader.h"
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
@@ -7,8 +8,45 @@
 #include <streambuf>
 #include <string>
 #include <vector>
+#include "embedded_resources.h"
 
-void Shader::compileShader() {
+namespace {
+
+constexpr int binary_version = 1;
+
+//FNV-1a, continued across several strings
+uint64_t fnv1a(const char* text, uint64_t h = 0xCBF29CE484222325ull) {
+  for (; *text; ++text) {
+    h ^= static_cast<unsigned char>(*text);
+    h *= 0x100000001B3ull;
+  }
+  //A separator keeps "ab" + "c" apart from "a" + "bc"
+  return (h ^ 0xFF) * 0x100000001B3ull;
+}
+
+//Never throws, a missing file reads as the oldest time
+std::filesystem::file_time_type modified(const std::string& path) {
+  std::error_code error;
+  return std::filesystem::last_write_time(path, error);
+}
+
+bool binary_supported() {
+  if (!GLAD_GL_VERSION_4_1)
+    return false;
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+}  // namespace
+
+bool Shader::compileShader(const std::string& binary_cache) {
+  const bool cached = !binary_cache.empty() && binary_supported();
+  const uint64_t key = cached ? binaryKey() : 0;
+  if (cached && loadBinary(binary_cache, key)) {
+    cacheUniforms();
+    return true;
+  }
   unsigned int vertex, fragment;
   // vertex shader
   const char* vCode = m_vertex_shader_code.c_str();
@@ -24,6 +62,9 @@ void Shader::compileShader() {
   checkShaderErrors(fragment, "FRAGMENT");
   // shader Program
   m_program_id = glCreateProgram();
+  if (cached)
+    glProgramParameteri(m_program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                        GL_TRUE);
   glAttachShader(m_program_id, vertex);
   glAttachShader(m_program_id, fragment);
   glLinkProgram(m_program_id);
@@ -31,6 +72,107 @@ void Shader::compileShader() {
   // delete the shaders as they're linked into our program now and no longer necessary
   glDeleteShader(vertex);
   glDeleteShader(fragment);
+  cacheUniforms();
+  GLint linked = 0;
+  glGetProgramiv(m_program_id, GL_LINK_STATUS, &linked);
+  if (cached && linked)
+    saveBinary(binary_cache, key);
+  return linked;
+}
+
+//Identifies the sources and the driver a binary was made by. Drivers also
+//refuse binaries they cannot use, this just saves asking them.
+uint64_t Shader::binaryKey() const {
+  uint64_t h = fnv1a(m_vertex_shader_code.c_str());
+  h = fnv1a(m_fragment_shader_code.c_str(), h);
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const GLubyte* text = glGetString(name);
+    h = fnv1a(text ? reinterpret_cast<const char*>(text) : "", h);
+  }
+  return h;
+}
+
+//The cache is a header line followed by the driver's binary:
+//  chip8-shader 1 <key> <format> <length>
+bool Shader::loadBinary(const std::string& file_name, uint64_t key) {
+  std::ifstream in(file_name, std::ios::binary);
+  std::string kind, key_text;
+  int version = 0;
+  GLenum format = 0;
+  GLsizei length = 0;
+  if (!(in >> kind >> version >> key_text >> format >> length) ||
+      kind != "chip8-shader" || version != binary_version ||
+      std::strtoull(key_text.c_str(), nullptr, 16) != key || length <= 0)
+    return false;
+  in.get();  // end of the header line
+  std::vector<char> binary(length);
+  if (!in.read(binary.data(), length))
+    return false;
+  const GLuint program = glCreateProgram();
+  glProgramBinary(program, format, binary.data(), length);
+  GLint linked = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (!linked) {
+    glDeleteProgram(program);
+    return false;
+  }
+  m_program_id = program;
+  return true;
+}
+
+//A cache that cannot be written only costs the compile on the next start
+void Shader::saveBinary(const std::string& file_name, uint64_t key) const {
+  GLint length = 0;
+  glGetProgramiv(m_program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(m_program_id, length, &length, &format, binary.data());
+  std::ofstream out(file_name, std::ios::binary);
+  char header[80];
+  std::snprintf(header, sizeof(header), "chip8-shader %d %016llx %u %d\n",
+                binary_version, static_cast<unsigned long long>(key), format,
+                length);
+  out << header;
+  out.write(binary.data(), length);
+}
+
+void Shader::cacheUniforms() {
+  m_uniforms.clear();
+  GLint count = 0, longest = 0;
+  glGetProgramiv(m_program_id, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(m_program_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &longest);
+  std::vector<char> name(std::max(longest, 1));
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(m_program_id, i, longest, &length, &size, &type,
+                       name.data());
+    //Members of uniform blocks have no location
+    const GLint at = glGetUniformLocation(m_program_id, name.data());
+    if (at < 0)
+      continue;
+    std::string uniform(name.data(), length);
+    //Arrays are listed as name[0], GL also accepts plain name
+    if (uniform.size() > 3 &&
+        uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+      m_uniforms.emplace(uniform.substr(0, uniform.size() - 3), at);
+    m_uniforms.emplace(std::move(uniform), at);
+  }
+}
+
+GLint Shader::location(const std::string& name) const {
+  const auto found = m_uniforms.find(name);
+  //-1 makes glUniform ignore the call, as for an unknown name
+  return found == m_uniforms.end() ? -1 : found->second;
+}
+
+void Shader::bindUniformBlock(const char* name, GLuint binding) {
+  const GLuint block = glGetUniformBlockIndex(m_program_id, name);
+  if (block != GL_INVALID_INDEX)
+    glUniformBlockBinding(m_program_id, block, binding);
 }
 
 void Shader::checkShaderErrors(GLuint id, const std::string type) {
@@ -65,6 +207,10 @@ void Shader::use() {
 
 void Shader::loadShaders(const char* vertexShaderFilePath,
                          const char* fragmentShaderFilePath) {
+  m_vertex_path = vertexShaderFilePath;
+  m_fragment_path = fragmentShaderFilePath;
+  m_vertex_time = modified(m_vertex_path);
+  m_fragment_time = modified(m_fragment_path);
   // retrieve the vertex/fragment source code from filePath
   std::string vertexCode;
   std::string fragmentCode;
@@ -96,13 +242,62 @@ void Shader::loadShaders(const char* vertexShaderFilePath,
   // m_fragment_shader_code = fragmentCode.c_str();
 }
 
+void Shader::loadEmbedded(const char* vertex_name,
+                          const char* fragment_name) {
+  m_vertex_path.clear();
+  m_fragment_path.clear();
+  const char* vertex = embedded_resource_text(vertex_name);
+  const char* fragment = embedded_resource_text(fragment_name);
+  m_vertex_shader_code = vertex ? vertex : "";
+  m_fragment_shader_code = fragment ? fragment : "";
+  if (!vertex || !fragment)
+    std::cout << "ERROR::SHADER::NOT_EMBEDDED: " << vertex_name << " "
+              << fragment_name << std::endl;
+}
+
+bool Shader::reloadIfChanged() {
+  if (m_vertex_path.empty() || (modified(m_vertex_path) == m_vertex_time &&
+                                modified(m_fragment_path) == m_fragment_time))
+    return false;
+  const std::string vertex = m_vertex_path, fragment = m_fragment_path;
+  const GLuint previous = m_program_id;
+  loadShaders(vertex.c_str(), fragment.c_str());
+  if (!compileShader()) {
+    //Keep drawing with the old program until the error is fixed
+    glDeleteProgram(m_program_id);
+    m_program_id = previous;
+    cacheUniforms();
+    return false;
+  }
+  glDeleteProgram(previous);
+  return true;
+}
+
 void Shader::setBool(const std::string& name, bool value) const {
-  glUniform1i(glGetUniformLocation(m_program_id, name.c_str()), (int)value);
+  glUniform1i(location(name), (int)value);
 }
 void Shader::setInt(const std::string& name, int value) const {
-  glUniform1i(glGetUniformLocation(m_program_id, name.c_str()), value);
+  glUniform1i(location(name), value);
 }
 
 void Shader::setFloat(const std::string& name, float value) const {
-  glUniform1f(glGetUniformLocation(m_program_id, name.c_str()), value);
-}
\ No newline at end of file
+  glUniform1f(location(name), value);
+}
+
+void uniform_buffer::create(GLuint binding, GLsizeiptr size) {
+  glGenBuffers(1, &m_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, m_buffer);
+}
+
+void uniform_buffer::update(const void* data, GLsizeiptr size) {
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+}
+
+void uniform_buffer::destroy() {
+  if (m_buffer)
+    glDeleteBuffers(1, &m_buffer);
+  m_buffer = 0;
+}
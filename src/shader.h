@@ -1,26 +1,68 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <cstdint>
+#include <filesystem>
 #include <string>
+#include <unordered_map>
 #include "GLFW/glfw3.h"
 #include "glad/glad.h"
 
 class Shader {
  public:
   void checkShaderErrors(GLuint shader_id, const std::string type);
-  void compileShader();
+  //With a cache file the linked program is loaded from there when the
+  //sources, driver and GPU are unchanged, and saved there after compiling.
+  //False when the program did not link.
+  bool compileShader(const std::string& binary_cache = "");
   void use();
   void loadShaders(const char* vertexShaderFilePath,
                    const char* fragmentShaderFilePath);
+  //Sources built into the executable from resources/, by file name
+  void loadEmbedded(const char* vertex_name, const char* fragment_name);
+  //After loadShaders(), compiles the files again once either has changed
+  //on disk. A program that fails to build leaves the old one in use.
+  //True when the program was replaced, uniform blocks need binding again.
+  bool reloadIfChanged();
+  //Connects the named uniform block to a uniform_buffer binding point. The
+  //shaders are GLSL 330, which cannot set it with layout(binding = N).
+  void bindUniformBlock(const char* name, GLuint binding);
   // utility uniform functions
   void setBool(const std::string& name, bool value) const;
   void setInt(const std::string& name, int value) const;
   void setFloat(const std::string& name, float value) const;
 
  private:
+  bool loadBinary(const std::string& file_name, uint64_t key);
+  void saveBinary(const std::string& file_name, uint64_t key) const;
+  uint64_t binaryKey() const;
+  void cacheUniforms();
+  GLint location(const std::string& name) const;
+
   std::string m_vertex_shader_code;
   std::string m_fragment_shader_code;
+  //Files the sources came from, empty for embedded ones
+  std::string m_vertex_path;
+  std::string m_fragment_path;
+  std::filesystem::file_time_type m_vertex_time;
+  std::filesystem::file_time_type m_fragment_time;
   GLuint m_program_id;
+  //Uniform locations, looked up once after linking
+  std::unordered_map<std::string, GLint> m_uniforms;
+};
+
+//A buffer behind a std140 uniform block, shared by every program bound to
+//the same binding point. Parameters that change at most once a frame go
+//here instead of one glUniform call per value.
+class uniform_buffer {
+ public:
+  void create(GLuint binding, GLsizeiptr size);
+  void update(const void* data, GLsizeiptr size);
+  //While the context is still current
+  void destroy();
+
+ private:
+  GLuint m_buffer = 0;
 };
 
-#endif
\ No newline at end of file
+#endif
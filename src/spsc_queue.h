@@ -0,0 +1,78 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+//Bounded single-producer/single-consumer queue. push() must only be called
+//from one thread and pop() from one (possibly different) thread.
+//Capacity must be a power of two so the indices can be masked instead of
+//wrapped with a modulo.
+template <typename T, std::size_t Capacity>
+class spsc_queue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "spsc_queue capacity must be a power of two");
+
+ public:
+  //Returns false if the queue is full, the item is dropped.
+  bool push(const T& item) {
+    const std::size_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+      return false;
+    m_items[head & (Capacity - 1)] = item;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  //Returns false if the queue is empty.
+  bool pop(T& item) {
+    const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire))
+      return false;
+    item = m_items[tail & (Capacity - 1)];
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  //Bulk variants, return how many items were actually transferred.
+  std::size_t push(const T* items, std::size_t count) {
+    const std::size_t head = m_head.load(std::memory_order_relaxed);
+    const std::size_t free =
+        Capacity - (head - m_tail.load(std::memory_order_acquire));
+    if (count > free)
+      count = free;
+    for (std::size_t i = 0; i < count; ++i)
+      m_items[(head + i) & (Capacity - 1)] = items[i];
+    m_head.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  std::size_t pop(T* items, std::size_t count) {
+    const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+    const std::size_t available =
+        m_head.load(std::memory_order_acquire) - tail;
+    if (count > available)
+      count = available;
+    for (std::size_t i = 0; i < count; ++i)
+      items[i] = m_items[(tail + i) & (Capacity - 1)];
+    m_tail.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  //Approximate when called concurrently with push()/pop().
+  std::size_t size() const {
+    return m_head.load(std::memory_order_acquire) -
+           m_tail.load(std::memory_order_acquire);
+  }
+
+  static constexpr std::size_t capacity() { return Capacity; }
+
+ private:
+  //Producer and consumer indices live on separate cache lines so the two
+  //threads don't bounce the same line back and forth.
+  alignas(64) std::atomic<std::size_t> m_head{0};
+  alignas(64) std::atomic<std::size_t> m_tail{0};
+  alignas(64) T m_items[Capacity];
+};
+
+#endif
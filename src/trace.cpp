@@ -0,0 +1,62 @@
+#include "trace.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+//File layout: header followed by size records in host byte order.
+struct trace_header {
+  char magic[4];  // "C8TR"
+  uint32_t version;
+  uint64_t size;   // records in the file
+  uint64_t total;  // records produced, including overwritten ones
+};
+
+constexpr uint32_t trace_version = 1;
+
+}  // namespace
+
+trace_recorder::trace_recorder(std::size_t capacity) {
+  std::size_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+  m_records.resize(size);
+  m_mask = size - 1;
+}
+
+bool trace_recorder::save(const std::string& file_name) const {
+  std::FILE* file = std::fopen(file_name.c_str(), "wb");
+  if (!file)
+    return false;
+  const trace_header header = {{'C', '8', 'T', 'R'}, trace_version, size(),
+                               m_total};
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+  //Oldest record first: once wrapped it sits right after the newest one
+  const std::size_t first = m_total > m_records.size() ? m_total & m_mask : 0;
+  const std::size_t tail = size() - first;
+  ok = ok && std::fwrite(&m_records[first], sizeof(trace_record), tail,
+                         file) == tail;
+  ok = ok && std::fwrite(m_records.data(), sizeof(trace_record), first,
+                         file) == first;
+  return std::fclose(file) == 0 && ok;
+}
+
+bool trace_recorder::load(const std::string& file_name,
+                          std::vector<trace_record>& records,
+                          uint64_t& total) {
+  std::FILE* file = std::fopen(file_name.c_str(), "rb");
+  if (!file)
+    return false;
+  trace_header header;
+  bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+            std::memcmp(header.magic, "C8TR", 4) == 0 &&
+            header.version == trace_version;
+  if (ok) {
+    records.resize(header.size);
+    total = header.total;
+    ok = std::fread(records.data(), sizeof(trace_record), records.size(),
+                    file) == records.size();
+  }
+  std::fclose(file);
+  return ok;
+}
@@ -0,0 +1,62 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "opcodes.h"
+
+//One executed instruction, 16 bytes so four records share a cache line.
+struct trace_record {
+  uint64_t cycle;
+  uint16_t pc;
+  uint16_t opcode;
+  uint16_t i;     // index register after the instruction
+  uint8_t reg;    // register written by the instruction or trace_no_reg
+  uint8_t value;  // new value of reg
+};
+static_assert(sizeof(trace_record) == 16, "trace_record must stay packed");
+
+constexpr uint8_t trace_no_reg = 0xFF;
+
+//Register an opcode writes, for FX65 the highest one loaded.
+inline uint8_t trace_written_reg(uint16_t opcode) {
+  const instruction_form* form = decode(opcode);
+  if (form && (form->effects & op_writes_vx))
+    return (opcode & 0x0F00) >> 8;
+  return trace_no_reg;
+}
+
+//Preallocated ring of the most recent instructions. record() is a single
+//16 byte store, older records are overwritten once the ring is full.
+class trace_recorder {
+ public:
+  //Capacity is rounded up to a power of two
+  explicit trace_recorder(std::size_t capacity = std::size_t(1) << 22);
+
+  void record(uint64_t cycle, uint16_t pc, uint16_t opcode, uint16_t i,
+              uint8_t reg, uint8_t value) {
+    m_records[m_total & m_mask] = {cycle, pc, opcode, i, reg, value};
+    ++m_total;
+  }
+
+  std::size_t size() const {
+    return m_total < m_records.size() ? m_total : m_records.size();
+  }
+  uint64_t total() const { return m_total; }
+  void clear() { m_total = 0; }
+
+  //Writes the retained records oldest first.
+  bool save(const std::string& file_name) const;
+  //Reads a file written by save(), returns false on a bad header.
+  static bool load(const std::string& file_name,
+                   std::vector<trace_record>& records, uint64_t& total);
+
+ private:
+  std::vector<trace_record> m_records;
+  std::size_t m_mask;
+  uint64_t m_total = 0;
+};
+
+#endif
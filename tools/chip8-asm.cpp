@@ -0,0 +1,34 @@
+//Assembles a listing, such as the output of chip8-disasm, into a ROM.
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "assembler.h"
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::fprintf(stderr, "usage: %s source.asm rom.ch8\n", argv[0]);
+    return 1;
+  }
+  std::ifstream in(argv[1]);
+  const std::string source((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+  if (!in) {
+    std::fprintf(stderr, "%s: could not read\n", argv[1]);
+    return 1;
+  }
+  std::vector<unsigned char> rom;
+  std::string error;
+  if (!assemble(source, rom, error)) {
+    std::fprintf(stderr, "%s: %s\n", argv[1], error.c_str());
+    return 1;
+  }
+  std::ofstream out(argv[2], std::ios::binary);
+  out.write(reinterpret_cast<const char*>(rom.data()), rom.size());
+  if (!out) {
+    std::fprintf(stderr, "%s: could not write\n", argv[2]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,253 @@
+//Runs chip8::emulate_cycle and the reference model in lockstep and reports
+//the first instruction after which their machine states differ.
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+#include "disasm.h"
+#include "reference_chip8.h"
+
+namespace {
+
+struct job {
+  std::string name;
+  std::vector<unsigned char> rom;
+};
+
+struct options {
+  unsigned long long cycles = 1000000;
+  unsigned random_streams = 64;
+  unsigned long long seed = 1;
+  unsigned frame_length = 11;  // instructions between timer ticks
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+//Name of the first field that differs, with both values.
+std::string compare(const chip8_state& a, const chip8_state& b) {
+  char text[32];
+  auto differs = [](const char* name, unsigned va, unsigned vb) {
+    char line[96];
+    std::snprintf(line, sizeof(line), "%s: interpreter 0x%X, reference 0x%X",
+                  name, va, vb);
+    return std::string(line);
+  };
+  if (a.PC != b.PC)
+    return differs("PC", a.PC, b.PC);
+  if (a.I != b.I)
+    return differs("I", a.I, b.I);
+  for (int i = 0; i < 16; ++i) {
+    if (a.V[i] != b.V[i]) {
+      std::snprintf(text, sizeof(text), "V%X", i);
+      return differs(text, a.V[i], b.V[i]);
+    }
+  }
+  if (a.sp != b.sp)
+    return differs("sp", a.sp, b.sp);
+  for (int i = 0; i < 16; ++i) {
+    if (a.stack[i] != b.stack[i]) {
+      std::snprintf(text, sizeof(text), "stack[%d]", i);
+      return differs(text, a.stack[i], b.stack[i]);
+    }
+  }
+  if (a.delay_timer != b.delay_timer)
+    return differs("delay timer", a.delay_timer, b.delay_timer);
+  if (a.sound_timer != b.sound_timer)
+    return differs("sound timer", a.sound_timer, b.sound_timer);
+  if (a.key_wait != b.key_wait)
+    return differs("key wait", a.key_wait, b.key_wait);
+  if (std::memcmp(a.memory, b.memory, sizeof(a.memory)) == 0 &&
+      std::memcmp(a.gfx, b.gfx, sizeof(a.gfx)) == 0)
+    return "";
+  for (int i = 0; i < 4096; ++i) {
+    if (a.memory[i] != b.memory[i]) {
+      std::snprintf(text, sizeof(text), "memory[0x%03X]", i);
+      return differs(text, a.memory[i], b.memory[i]);
+    }
+  }
+  for (int i = 0; i < 64 * 32; ++i) {
+    if (a.gfx[i] != b.gfx[i]) {
+      std::snprintf(text, sizeof(text), "pixel (%d, %d)", i % 64, i / 64);
+      return differs(text, a.gfx[i], b.gfx[i]);
+    }
+  }
+  return "";
+}
+
+std::string listing(const chip8_state& s, unsigned pc) {
+  std::string text;
+  const unsigned first = pc >= 8 ? pc - 8 : 0;
+  for (unsigned address = first; address <= pc + 8 && address < 0xFFF;
+       address += 2) {
+    const unsigned op = s.memory[address] << 8 | s.memory[address + 1];
+    char line[64];
+    std::snprintf(line, sizeof(line), "  %s 0x%03X  %04X  %s\n",
+                  address == pc ? ">" : " ", address, op,
+                  disassemble(static_cast<uint16_t>(op)).c_str());
+    text += line;
+  }
+  return text;
+}
+
+//Returns an empty string when both sides agree for the whole run.
+std::string run(const job& j, const options& opt) {
+  chip8 machine;
+  machine.initialize();
+  machine.load_game(j.rom.data(), j.rom.size());
+  chip8_state& impl = machine.state();
+  chip8_state ref = impl;
+
+  for (unsigned long long cycle = 0; cycle < opt.cycles; ++cycle) {
+    const unsigned short pc = impl.PC;
+    machine.emulate_cycle();
+    //Feed the interpreter's random byte to the reference
+    const unsigned char random = impl.V[(impl.opcode & 0x0F00) >> 8];
+    reference_step(ref, random);
+    if (cycle % opt.frame_length == opt.frame_length - 1) {
+      machine.tick_timers();
+      reference_tick_timers(ref);
+    }
+
+    std::string diff = compare(impl, ref);
+    if (!diff.empty()) {
+      char text[96];
+      std::snprintf(text, sizeof(text),
+                    "diverged at cycle %llu after %04X (%s)\n  ", cycle,
+                    impl.opcode, disassemble(impl.opcode).c_str());
+      return text + diff + "\n" + listing(ref, pc);
+    }
+  }
+  return "";
+}
+
+//Random but mostly well-formed program: jump targets land on instruction
+//boundaries inside the program so control flow keeps exercising it.
+std::vector<unsigned char> random_program(std::mt19937_64& rng) {
+  static const uint16_t patterns[] = {
+      0x00E0, 0x00EE, 0x1000, 0x2000, 0x3000, 0x4000, 0x5000, 0x6000,
+      0x7000, 0x8000, 0x8001, 0x8002, 0x8003, 0x8004, 0x8005, 0x8006,
+      0x8007, 0x800E, 0x9000, 0xA000, 0xB000, 0xC000, 0xD000, 0xE09E,
+      0xE0A1, 0xF007, 0xF015, 0xF018, 0xF01E, 0xF029, 0xF033, 0xF055,
+      0xF065};
+  const unsigned length = 16 + rng() % 512;  // instructions
+  std::vector<unsigned char> rom(length * 2);
+  for (unsigned i = 0; i < length; ++i) {
+    uint16_t op;
+    if (rng() % 16 == 0) {
+      op = static_cast<uint16_t>(rng());  // raw noise
+    } else {
+      op = patterns[rng() % (sizeof(patterns) / sizeof(patterns[0]))];
+      const unsigned x = rng() & 0xF;
+      const unsigned y = rng() & 0xF;
+      switch (op >> 12) {
+        case 0x1:
+        case 0x2:
+        case 0xB:
+          op |= 0x200 + 2 * (rng() % length);
+          break;
+        case 0xA:
+          op |= rng() % 0x1000;
+          break;
+        case 0x3:
+        case 0x4:
+        case 0x6:
+        case 0x7:
+        case 0xC:
+          op |= x << 8 | (rng() & 0xFF);
+          break;
+        case 0x5:
+        case 0x8:
+        case 0x9:
+          op |= x << 8 | y << 4;
+          break;
+        case 0xD:
+          op |= x << 8 | y << 4 | (rng() & 0xF);
+          break;
+        case 0xE:
+        case 0xF:
+          op |= x << 8;
+          break;
+      }
+    }
+    rom[2 * i] = op >> 8;
+    rom[2 * i + 1] = op & 0xFF;
+  }
+  return rom;
+}
+
+void usage(const char* program) {
+  std::fprintf(stderr,
+               "usage: %s [options] [rom.ch8 ...]\n"
+               "  --cycles N    instructions per run (default 1000000)\n"
+               "  --random N    random programs to run (default 64)\n"
+               "  --seed N      seed for the random programs\n"
+               "  --threads N   worker threads (default: all cores)\n",
+               program);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  options opt;
+  std::vector<job> jobs;
+  for (int a = 1; a < argc; ++a) {
+    const bool has_value = a + 1 < argc;
+    if (!std::strcmp(argv[a], "--cycles") && has_value) {
+      opt.cycles = std::strtoull(argv[++a], nullptr, 0);
+    } else if (!std::strcmp(argv[a], "--random") && has_value) {
+      opt.random_streams = std::strtoul(argv[++a], nullptr, 0);
+    } else if (!std::strcmp(argv[a], "--seed") && has_value) {
+      opt.seed = std::strtoull(argv[++a], nullptr, 0);
+    } else if (!std::strcmp(argv[a], "--threads") && has_value) {
+      opt.threads = std::max(1ul, std::strtoul(argv[++a], nullptr, 0));
+    } else if (argv[a][0] == '-') {
+      usage(argv[0]);
+      return 1;
+    } else {
+      std::ifstream file(argv[a], std::ios::binary);
+      std::vector<unsigned char> rom((std::istreambuf_iterator<char>(file)),
+                                     std::istreambuf_iterator<char>());
+      if (!file || rom.empty() || rom.size() > 4096 - 0x200) {
+        std::fprintf(stderr, "%s: not a loadable ROM\n", argv[a]);
+        return 1;
+      }
+      jobs.push_back({argv[a], rom});
+    }
+  }
+  std::mt19937_64 rng(opt.seed);
+  for (unsigned i = 0; i < opt.random_streams; ++i)
+    jobs.push_back({"random #" + std::to_string(i), random_program(rng)});
+
+  std::atomic<std::size_t> next{0};
+  std::atomic<unsigned> failures{0};
+  std::mutex output;
+  auto worker = [&] {
+    for (std::size_t i; (i = next++) < jobs.size();) {
+      const std::string failure = run(jobs[i], opt);
+      std::lock_guard<std::mutex> lock(output);
+      if (!failure.empty()) {
+        ++failures;
+        std::printf("FAIL %s: %s", jobs[i].name.c_str(), failure.c_str());
+      } else {
+        std::printf("ok   %s\n", jobs[i].name.c_str());
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < std::min<std::size_t>(opt.threads, jobs.size());
+       ++t)
+    pool.emplace_back(worker);
+  for (auto& t : pool)
+    t.join();
+
+  std::printf("%zu runs, %u diverged\n", jobs.size(), failures.load());
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+//Disassembles ROMs by recursive descent, separating code from data, or
+//prints their basic block boundaries or analysis for batch processing a ROM
+//corpus.
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "code_map.h"
+#include "disasm.h"
+#include "rom_analysis.h"
+
+namespace {
+
+void usage(const char* program) {
+  std::fprintf(stderr,
+               "usage: %s [options] rom.ch8 ...\n"
+               "  --linear   decode every word instead of following the code\n"
+               "  --blocks   print basic block start addresses, one line per "
+               "ROM\n"
+               "  --analyze  write the analysis cache next to each ROM and "
+               "summarize it\n",
+               program);
+}
+
+//Every word as an instruction, like a hex dump with mnemonics
+std::string list_linear(const std::vector<unsigned char>& rom) {
+  std::string text;
+  char line[64];
+  for (std::size_t at = 0; at + 1 < rom.size(); at += 2) {
+    const uint16_t opcode = rom[at] << 8 | rom[at + 1];
+    std::snprintf(line, sizeof(line), "0x%03zX  %04X  ", 0x200 + at, opcode);
+    text += line + disassemble(opcode) + "\n";
+  }
+  if (rom.size() % 2) {
+    std::snprintf(line, sizeof(line), "0x%03zX  %02X\n", 0x200 + rom.size() - 1,
+                  rom.back());
+    text += line;
+  }
+  return text;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool linear = false;
+  bool blocks = false;
+  bool analyze = false;
+  std::vector<const char*> files;
+  for (int a = 1; a < argc; ++a) {
+    if (!std::strcmp(argv[a], "--linear")) {
+      linear = true;
+    } else if (!std::strcmp(argv[a], "--blocks")) {
+      blocks = true;
+    } else if (!std::strcmp(argv[a], "--analyze")) {
+      analyze = true;
+    } else if (argv[a][0] == '-') {
+      usage(argv[0]);
+      return 1;
+    } else {
+      files.push_back(argv[a]);
+    }
+  }
+  if (files.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int status = 0;
+  for (const char* file_name : files) {
+    std::ifstream file(file_name, std::ios::binary);
+    const std::vector<unsigned char> rom((std::istreambuf_iterator<char>(file)),
+                                         std::istreambuf_iterator<char>());
+    if (!file || rom.empty() || rom.size() > 4096 - 0x200) {
+      std::fprintf(stderr, "%s: not a loadable ROM\n", file_name);
+      status = 1;
+      continue;
+    }
+    if (linear) {
+      if (files.size() > 1)
+        std::printf("; %s\n", file_name);
+      std::fputs(list_linear(rom).c_str(), stdout);
+      continue;
+    }
+    if (analyze) {
+      const rom_analysis result = analyze_rom(rom.data(), rom.size());
+      std::size_t modified = 0;
+      for (const basic_block& b : result.blocks)
+        modified += b.self_modifying;
+      std::printf("%s: %zu blocks, %zu self-modifying, %zu subroutines, "
+                  "%u unresolved writes%s\n",
+                  file_name, result.blocks.size(), modified,
+                  result.subroutines.size(), result.unresolved_writes,
+                  result.indirect ? ", computed jumps" : "");
+      if (!save_analysis(std::string(file_name) + ".analysis", result)) {
+        std::fprintf(stderr, "%s: could not write the analysis\n", file_name);
+        status = 1;
+      }
+      continue;
+    }
+    const code_map map = map_code(rom.data(), rom.size());
+    if (blocks) {
+      std::printf("%s:", file_name);
+      for (uint16_t start : map.blocks)
+        std::printf(" 0x%03X", start);
+      std::printf("%s\n", map.indirect ? " +indirect" : "");
+      continue;
+    }
+    std::size_t code = 0;
+    for (unsigned char kind : map.kind)
+      code += kind != byte_data;
+    std::printf("; %s, %zu bytes, %zu of them code%s\n", file_name,
+                rom.size(), code,
+                map.indirect ? ", has computed jumps (BNNN)" : "");
+    std::fputs(list_code(rom.data(), rom.size(), map).c_str(), stdout);
+  }
+  return status;
+}
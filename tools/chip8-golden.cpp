@@ -0,0 +1,378 @@
+//Runs ROMs headlessly and compares the hash of every frame against a golden
+//file, or records one. A golden file names the ROM, how long and how fast to
+//run it, the CXNN seed and optionally a movie of key presses, followed by
+//the frame hashes:
+//  chip8-golden 1
+//  rom ../programs/2-ibm-logo.ch8
+//  frames 600
+//  ipf 11
+//  seed 1
+//  movie ibm.movie
+//  0 9b1c0e3f5a2d4c77
+//  38 4e5d...
+//  screen
+//  ....####....  (32 rows of 64 pixels, # lit)
+//Each hash line gives the frame it first appears on, frames in between
+//have the same screen. The screen block is the last frame, so a failure
+//shows what the ROM drew. Paths are relative to the golden file. A movie
+//has one "frame key down|up" line per key event, applied before that
+//frame, with the key as a hex digit.
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+#include "frame_hash.h"
+#include "jit.h"
+
+namespace {
+
+struct key_press {
+  unsigned frame;
+  unsigned char key;
+  bool pressed;
+};
+
+struct test {
+  std::string name;
+  std::string rom_path;
+  std::string movie_path;
+  unsigned frames = 600;
+  int ipf = 11;
+  unsigned seed = 1;
+  std::vector<uint64_t> expected;  // one hash per frame
+  std::string screen;              // last frame as text, empty if not recorded
+};
+
+constexpr int screen_width = 64;
+constexpr int screen_height = 32;
+
+struct options {
+  bool jit = false;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+namespace fs = std::filesystem;
+
+//path as seen from the directory of the golden file
+std::string relative_to(const std::string& golden, const std::string& path) {
+  const fs::path base = fs::absolute(golden).parent_path();
+  return fs::relative(fs::absolute(path), base).generic_string();
+}
+
+std::string resolve(const std::string& golden, const std::string& path) {
+  return (fs::path(golden).parent_path() / path).string();
+}
+
+//One line per display row, # for lit pixels
+std::string screen_text(const unsigned char* gfx) {
+  std::string text;
+  for (int y = 0; y < screen_height; ++y) {
+    for (int x = 0; x < screen_width; ++x)
+      text += gfx[y * screen_width + x] ? '#' : '.';
+    text += '\n';
+  }
+  return text;
+}
+
+std::string format_row(const std::string& left, const std::string& right,
+                       char mark) {
+  std::string row = left;
+  row.resize(screen_width, ' ');
+  return row + ' ' + mark + ' ' + right + '\n';
+}
+
+//Expected and actual side by side, rows that differ marked with *
+std::string screen_diff(const std::string& expected,
+                        const std::string& actual) {
+  std::string text = format_row("expected", "actual", ' ');
+  std::istringstream left(expected), right(actual);
+  std::string a, b;
+  while (std::getline(left, a) && std::getline(right, b))
+    text += format_row(a, b, a == b ? ' ' : '*');
+  return text;
+}
+
+bool read_file(const std::string& path, std::vector<unsigned char>& data) {
+  std::ifstream file(path, std::ios::binary);
+  data.assign(std::istreambuf_iterator<char>(file),
+              std::istreambuf_iterator<char>());
+  return static_cast<bool>(file);
+}
+
+//Empty error on success
+std::string load_movie(const std::string& path, std::vector<key_press>& keys) {
+  std::ifstream file(path);
+  if (!file)
+    return "cannot open movie " + path;
+  std::string line;
+  for (int number = 1; std::getline(file, line); ++number) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    unsigned frame;
+    std::string key, state;
+    if (!(fields >> frame))
+      continue;  // blank or comment
+    //Keys are the hex digits of the keypad
+    if (!(fields >> key >> state) || key.size() != 1 ||
+        !std::isxdigit(static_cast<unsigned char>(key[0])) ||
+        (state != "down" && state != "up"))
+      return path + ":" + std::to_string(number) +
+             ": expected frame key down|up";
+    keys.push_back({frame,
+                    static_cast<unsigned char>(std::stoul(key, nullptr, 16)),
+                    state == "down"});
+  }
+  std::stable_sort(keys.begin(), keys.end(),
+                   [](const key_press& a, const key_press& b) {
+                     return a.frame < b.frame;
+                   });
+  return "";
+}
+
+std::string load_golden(const std::string& path, test& t) {
+  std::ifstream file(path);
+  if (!file)
+    return "cannot open";
+  std::string line, key;
+  unsigned version = 0;
+  if (!std::getline(file, line) ||
+      std::sscanf(line.c_str(), "chip8-golden %u", &version) != 1)
+    return "not a golden file";
+  if (version != frame_hash_version)
+    return "recorded with frame hash version " + std::to_string(version) +
+           ", record it again";
+  std::vector<std::pair<unsigned, uint64_t>> changes;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    if (!(fields >> key) || key[0] == '#')
+      continue;
+    if (key == "rom") {
+      fields >> t.rom_path;
+      t.rom_path = resolve(path, t.rom_path);
+    } else if (key == "movie") {
+      fields >> t.movie_path;
+      t.movie_path = resolve(path, t.movie_path);
+    } else if (key == "frames") {
+      fields >> t.frames;
+    } else if (key == "ipf") {
+      fields >> t.ipf;
+    } else if (key == "seed") {
+      fields >> t.seed;
+    } else if (key == "screen") {
+      for (int y = 0; y < screen_height && std::getline(file, line); ++y)
+        t.screen += line + "\n";
+    } else {
+      std::string hash;
+      fields >> hash;
+      changes.emplace_back(std::strtoul(key.c_str(), nullptr, 10),
+                           std::strtoull(hash.c_str(), nullptr, 16));
+    }
+  }
+  if (t.rom_path.empty() || changes.empty() || changes[0].first != 0)
+    return "needs a rom and the hash of frame 0";
+  t.expected.resize(t.frames);
+  std::size_t c = 0;
+  for (unsigned frame = 0; frame < t.frames; ++frame) {
+    if (c + 1 < changes.size() && changes[c + 1].first == frame)
+      ++c;
+    t.expected[frame] = changes[c].second;
+  }
+  return "";
+}
+
+//Hash of every frame up to frames, and the text of the last one, or an
+//error
+std::string run(const test& t, const options& opt, unsigned frames,
+                std::vector<uint64_t>& hashes, std::string& screen) {
+  std::vector<unsigned char> rom;
+  if (!read_file(t.rom_path, rom) || rom.empty() || rom.size() > 4096 - 0x200)
+    return "not a loadable ROM: " + t.rom_path;
+  std::vector<key_press> keys;
+  if (!t.movie_path.empty()) {
+    const std::string error = load_movie(t.movie_path, keys);
+    if (!error.empty())
+      return error;
+  }
+  chip8 machine;
+  machine.initialize();
+  machine.seed_random(t.seed);
+  machine.set_speed(t.ipf);
+  machine.load_game(rom.data(), rom.size());
+  std::unique_ptr<jit> translator;
+  if (opt.jit && jit::supported()) {
+    translator = std::make_unique<jit>();
+    machine.set_jit(translator.get());
+  }
+  hashes.resize(frames);
+  std::size_t next_key = 0;
+  for (unsigned frame = 0; frame < frames; ++frame) {
+    for (; next_key < keys.size() && keys[next_key].frame == frame; ++next_key)
+      machine.key_event(keys[next_key].key, keys[next_key].pressed);
+    machine.run_frame();
+    hashes[frame] = frame_hash(machine.gfx);
+  }
+  screen = screen_text(machine.gfx);
+  return "";
+}
+
+//Empty when every frame matches, otherwise what went wrong with the
+//screens involved
+std::string check(const test& t, const options& opt) {
+  std::vector<uint64_t> hashes;
+  std::string screen;
+  std::string failure = run(t, opt, t.frames, hashes, screen);
+  if (!failure.empty())
+    return failure;
+  if (!t.screen.empty() && screen != t.screen)
+    return "last frame differs\n" + screen_diff(t.screen, screen);
+  const auto mismatch =
+      std::mismatch(hashes.begin(), hashes.end(), t.expected.begin());
+  if (mismatch.first == hashes.end())
+    return "";
+  //Run again up to the first bad frame to show it
+  const unsigned frame =
+      static_cast<unsigned>(mismatch.first - hashes.begin());
+  char text[96];
+  std::snprintf(text, sizeof(text),
+                "frame %u is %016" PRIx64 ", expected %016" PRIx64 "\n",
+                frame, *mismatch.first, *mismatch.second);
+  run(t, opt, frame + 1, hashes, screen);
+  return text + screen;
+}
+
+bool record(const std::string& path, const test& t, const options& opt) {
+  std::vector<uint64_t> hashes;
+  std::string screen;
+  const std::string error = run(t, opt, t.frames, hashes, screen);
+  if (!error.empty()) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return false;
+  }
+  std::FILE* out = path == "-" ? stdout : std::fopen(path.c_str(), "w");
+  if (!out) {
+    std::fprintf(stderr, "cannot write %s\n", path.c_str());
+    return false;
+  }
+  //Paths are stored relative to the golden file so the suite can move
+  const std::string golden = out == stdout ? "./-" : path;
+  std::fprintf(out, "chip8-golden %u\nrom %s\nframes %u\nipf %d\nseed %u\n",
+               frame_hash_version, relative_to(golden, t.rom_path).c_str(),
+               t.frames, t.ipf, t.seed);
+  if (!t.movie_path.empty())
+    std::fprintf(out, "movie %s\n",
+                 relative_to(golden, t.movie_path).c_str());
+  for (unsigned frame = 0; frame < t.frames; ++frame) {
+    if (frame == 0 || hashes[frame] != hashes[frame - 1])
+      std::fprintf(out, "%u %016" PRIx64 "\n", frame, hashes[frame]);
+  }
+  std::fprintf(out, "screen\n%s", screen.c_str());
+  return out == stdout || std::fclose(out) == 0;
+}
+
+void usage(const char* program) {
+  std::fprintf(stderr,
+               "usage: %s [options] test.golden ...\n"
+               "       %s --record test.golden [options] rom.ch8\n"
+               "  --record FILE  write the hash of every frame to FILE, - for "
+               "stdout\n"
+               "  --movie FILE   key events to replay, \"frame key down|up\" "
+               "lines\n"
+               "  --frames N     frames to record (default 600)\n"
+               "  --ipf N        instructions per frame to record with, 0 for "
+               "VIP timing\n"
+               "                 (default 11)\n"
+               "  --seed N       CXNN seed to record with (default 1)\n"
+               "  --jit          run translated code where possible\n"
+               "  --threads N    worker threads (default: all cores)\n",
+               program, program);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  options opt;
+  std::string record_path;
+  test recording;
+  std::vector<std::string> paths;
+  for (int a = 1; a < argc; ++a) {
+    const bool has_value = a + 1 < argc;
+    if (!std::strcmp(argv[a], "--record") && has_value) {
+      record_path = argv[++a];
+    } else if (!std::strcmp(argv[a], "--movie") && has_value) {
+      recording.movie_path = argv[++a];
+    } else if (!std::strcmp(argv[a], "--frames") && has_value) {
+      recording.frames = std::strtoul(argv[++a], nullptr, 0);
+    } else if (!std::strcmp(argv[a], "--ipf") && has_value) {
+      recording.ipf = std::atoi(argv[++a]);
+    } else if (!std::strcmp(argv[a], "--seed") && has_value) {
+      recording.seed = std::strtoul(argv[++a], nullptr, 0);
+    } else if (!std::strcmp(argv[a], "--jit")) {
+      opt.jit = true;
+    } else if (!std::strcmp(argv[a], "--threads") && has_value) {
+      opt.threads = std::max(1ul, std::strtoul(argv[++a], nullptr, 0));
+    } else if (argv[a][0] == '-') {
+      usage(argv[0]);
+      return 1;
+    } else {
+      paths.push_back(argv[a]);
+    }
+  }
+
+  if (!record_path.empty()) {
+    if (paths.size() != 1) {
+      usage(argv[0]);
+      return 1;
+    }
+    recording.rom_path = paths[0];
+    return record(record_path, recording, opt) ? 0 : 1;
+  }
+  if (paths.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::atomic<std::size_t> next{0};
+  std::atomic<unsigned> failures{0};
+  std::mutex output;
+  auto worker = [&] {
+    for (std::size_t i; (i = next++) < paths.size();) {
+      test t;
+      t.name = paths[i];
+      std::string failure = load_golden(paths[i], t);
+      if (failure.empty())
+        failure = check(t, opt);
+      //Multi-line failures carry the screens, one newline after them
+      if (!failure.empty() && failure.back() == '\n')
+        failure.pop_back();
+      std::lock_guard<std::mutex> lock(output);
+      if (!failure.empty()) {
+        ++failures;
+        std::printf("FAIL %s: %s\n", t.name.c_str(), failure.c_str());
+      } else {
+        std::printf("ok   %s\n", t.name.c_str());
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < std::min<std::size_t>(opt.threads, paths.size());
+       ++t)
+    pool.emplace_back(worker);
+  for (auto& t : pool)
+    t.join();
+
+  std::printf("%zu tests, %u failed\n", paths.size(), failures.load());
+  return failures ? 1 : 0;
+}
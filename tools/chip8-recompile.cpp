@@ -0,0 +1,346 @@
+//Translates a ROM into C++, one function per basic block, to be built into
+//a plugin the emulator loads in place of interpreting the ROM:
+//  chip8-recompile game.ch8 game.cpp
+//  c++ -O2 -shared -fPIC -Isrc game.cpp -o game.ch8.so
+#include <cstdarg>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "disasm.h"
+#include "rom_analysis.h"
+
+namespace {
+
+constexpr unsigned origin = 0x200;
+
+std::string format(const char* text, ...) {
+  char buffer[512];
+  va_list args;
+  va_start(args, text);
+  std::vsnprintf(buffer, sizeof(buffer), text, args);
+  va_end(args);
+  return buffer;
+}
+
+//What a block being generated needs to know about its surroundings
+struct block_context {
+  unsigned start;
+  unsigned end;          // of the analysed block, writes into it stop the code
+  unsigned count;        // instructions emitted so far, this one included
+  bool uses_host = false;
+};
+
+std::string skip(const std::string& condition, unsigned address) {
+  return format("  s.PC = (%s) ? 0x%03X : 0x%03X;\n", condition.c_str(),
+                address + 4, address + 2);
+}
+
+//C++ for the instruction at address. Returns false for what only the
+//interpreter can do (FX0A waits, FX18's sound edge is timed, unknown
+//opcodes stall), sets ends when the code sets PC itself.
+bool translate(uint16_t op, unsigned address, block_context& block,
+               std::string& code, bool& ends) {
+  const instruction_form* form = decode(op);
+  if (!form || form->flow == control::stop ||
+      (form->effects & op_interpreted))
+    return false;
+  const unsigned x = (op & 0x0F00) >> 8;
+  const unsigned n = op & 0x000F;
+  const unsigned nn = op & 0x00FF;
+  const unsigned nnn = op & 0x0FFF;
+  const std::string vx = format("s.V[0x%X]", x);
+  const std::string vy = format("s.V[0x%X]", (op & 0x00F0) >> 4);
+  const char* vxs = vx.c_str();
+  const char* vys = vy.c_str();
+  //Stops the block when a write lands in its own code, the rest of it may
+  //not be what was compiled any more
+  const std::string write_check = format(
+      "    if (chip8_overlaps(first, %%u, 0x%03X, 0x%03X)) {\n"
+      "      s.opcode = 0x%04X;\n"
+      "      s.PC = 0x%03X;\n"
+      "      return {%u, flags};\n"
+      "    }\n",
+      block.start, block.end, op, address + 2, block.count);
+  ends = form->flow != control::next;
+  if (form->effects & (op_random | op_writes_memory))
+    block.uses_host = true;
+  switch (form->kind) {
+    case op_kind::cls:
+      code = "  std::memset(s.gfx, 0, sizeof(s.gfx));\n"
+             "  flags |= block_drew;\n";
+      break;
+    case op_kind::ret:
+      code = "  s.sp = (s.sp - 1) & 0xF;\n"
+             "  s.PC = static_cast<unsigned short>(s.stack[s.sp] + 2);\n";
+      break;
+    case op_kind::jp:
+      code = format("  s.PC = 0x%03X;\n", nnn);
+      break;
+    case op_kind::call:
+      code = format(
+          "  s.stack[s.sp & 0xF] = 0x%03X;\n"
+          "  s.sp = (s.sp + 1) & 0xF;\n"
+          "  s.PC = 0x%03X;\n",
+          address, nnn);
+      break;
+    case op_kind::se_byte:
+      code = skip(format("%s == 0x%02X", vxs, nn), address);
+      break;
+    case op_kind::sne_byte:
+      code = skip(format("%s != 0x%02X", vxs, nn), address);
+      break;
+    case op_kind::se_reg:
+      code = skip(vx + " == " + vy, address);
+      break;
+    case op_kind::sne_reg:
+      code = skip(vx + " != " + vy, address);
+      break;
+    case op_kind::ld_byte:
+      code = format("  %s = 0x%02X;\n", vxs, nn);
+      break;
+    case op_kind::add_byte:
+      code = format("  %s = static_cast<unsigned char>(%s + 0x%02X);\n", vxs,
+                    vxs, nn);
+      break;
+    case op_kind::ld_reg:
+      code = format("  %s = %s;\n", vxs, vys);
+      break;
+    case op_kind::or_reg:
+      code = format("  %s |= %s;\n", vxs, vys);
+      break;
+    case op_kind::and_reg:
+      code = format("  %s &= %s;\n", vxs, vys);
+      break;
+    case op_kind::xor_reg:
+      code = format("  %s ^= %s;\n", vxs, vys);
+      break;
+    case op_kind::add_reg:
+      code = format(
+          "  {\n"
+          "    const unsigned sum = %s + %s;\n"
+          "    %s = sum & 0xFF;\n"
+          "    s.V[0xF] = sum > 0xFF;\n"
+          "  }\n",
+          vxs, vys, vxs);
+      break;
+    case op_kind::sub_reg:
+    case op_kind::subn_reg: {
+      const char* a = form->kind == op_kind::sub_reg ? vxs : vys;
+      const char* b = form->kind == op_kind::sub_reg ? vys : vxs;
+      code = format(
+          "  {\n"
+          "    const unsigned char flag = %s >= %s;\n"
+          "    %s = static_cast<unsigned char>(%s - %s);\n"
+          "    s.V[0xF] = flag;\n"
+          "  }\n",
+          a, b, vxs, a, b);
+      break;
+    }
+    case op_kind::shr:
+      code = format(
+          "  {\n"
+          "    const unsigned char flag = %s & 1;\n"
+          "    %s >>= 1;\n"
+          "    s.V[0xF] = flag;\n"
+          "  }\n",
+          vxs, vxs);
+      break;
+    case op_kind::shl:
+      code = format(
+          "  {\n"
+          "    const unsigned char flag = %s >> 7;\n"
+          "    %s = static_cast<unsigned char>(%s << 1);\n"
+          "    s.V[0xF] = flag;\n"
+          "  }\n",
+          vxs, vxs, vxs);
+      break;
+    case op_kind::ld_i:
+      code = format("  s.I = 0x%03X;\n", nnn);
+      break;
+    case op_kind::jp_v0:
+      code = format("  s.PC = static_cast<unsigned short>(0x%03X + s.V[0]);\n",
+                    nnn);
+      break;
+    case op_kind::rnd:
+      code = format("  %s = host.random(host.context) & 0x%02X;\n", vxs, nn);
+      break;
+    case op_kind::drw:
+      code = format(
+          "  chip8_draw(s, %s, %s, %u);\n"
+          "  flags |= block_drew | block_vblank;\n",
+          vxs, vys, n);
+      break;
+    case op_kind::skp:
+      code = skip(format("s.key[%s & 0xF] == 1", vxs), address);
+      break;
+    case op_kind::sknp:
+      code = skip(format("s.key[%s & 0xF] == 0", vxs), address);
+      break;
+    case op_kind::ld_from_dt:
+      code = format("  %s = s.delay_timer;\n", vxs);
+      break;
+    case op_kind::ld_dt:
+      code = format("  s.delay_timer = %s;\n", vxs);
+      break;
+    case op_kind::add_i:
+      code = format(
+          "  {\n"
+          "    const unsigned char flag = s.I + %s > 0xFFF;\n"
+          "    s.I = static_cast<unsigned short>(s.I + %s);\n"
+          "    s.V[0xF] = flag;\n"
+          "  }\n",
+          vxs, vxs);
+      break;
+    case op_kind::ld_font:
+      code = format("  s.I = static_cast<unsigned short>(%s * 5);\n", vxs);
+      break;
+    case op_kind::ld_bcd:
+      code = format(
+          "  {\n"
+          "    const unsigned first = s.I;\n"
+          "    chip8_write(s, first, chip8_bcd.digits[%s], 3);\n",
+          vxs) +
+          "    host.stored(host.context, first, 3);\n" +
+          format(write_check.c_str(), 3u) + "  }\n";
+      break;
+    case op_kind::ld_store:
+      code = format(
+          "  {\n"
+          "    const unsigned first = s.I;\n"
+          "    chip8_write(s, first, s.V, 0x%X);\n"
+          "    s.I = static_cast<unsigned short>(first + 0x%X);\n",
+          x + 1, x + 1) +
+          format("    host.stored(host.context, first, %u);\n", x + 1) +
+          format(write_check.c_str(), x + 1) + "  }\n";
+      break;
+    case op_kind::ld_load:
+      code = format(
+          "  chip8_read(s, s.I, s.V, 0x%X);\n"
+          "  s.I = static_cast<unsigned short>(s.I + 0x%X);\n",
+          x + 1, x + 1);
+      break;
+    case op_kind::sys:
+    case op_kind::ld_key:
+    case op_kind::ld_st:
+      return false;
+  }
+  return true;
+}
+
+struct generated_block {
+  unsigned start;
+  unsigned end;
+  unsigned instructions;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::fprintf(stderr, "usage: %s rom.ch8 output.cpp\n", argv[0]);
+    return 1;
+  }
+  std::ifstream file(argv[1], std::ios::binary);
+  const std::vector<unsigned char> rom((std::istreambuf_iterator<char>(file)),
+                                       std::istreambuf_iterator<char>());
+  if (!file || rom.empty() || rom.size() > 4096 - origin) {
+    std::fprintf(stderr, "%s: not a loadable ROM\n", argv[1]);
+    return 1;
+  }
+  const rom_analysis analysis = analyze_rom(rom.data(), rom.size());
+  auto word = [&](unsigned address) -> uint16_t {
+    return rom[address - origin] << 8 | rom[address - origin + 1];
+  };
+
+  std::string functions;
+  std::vector<generated_block> blocks;
+  unsigned skipped = 0;
+  for (const basic_block& b : analysis.blocks) {
+    //Known to be rewritten at run time, the interpreter handles it
+    if (b.self_modifying) {
+      ++skipped;
+      continue;
+    }
+    //A block is cut wherever the interpreter has to take over, the code
+    //after such an instruction becomes a block of its own
+    for (unsigned address = b.start; address < b.end;) {
+      block_context context{address, b.end, 0};
+      std::string body;
+      uint16_t last = 0;
+      bool ended = false;
+      const unsigned start = address;
+      while (address < b.end && !ended) {
+        const uint16_t op = word(address);
+        ++context.count;
+        std::string code;
+        if (!translate(op, address, context, code, ended)) {
+          --context.count;
+          break;
+        }
+        body += format("  // 0x%03X  %04X  %s\n", address, op,
+                       disassemble(op).c_str()) +
+                code;
+        last = op;
+        address += 2;
+      }
+      if (context.count > 0) {
+        functions += format(
+            "\nconst unsigned char bytes_%03X[] = {", start);
+        for (unsigned a = start; a < address; ++a)
+          functions += format("%s0x%02X", a == start ? "" : ", ",
+                              rom[a - origin]);
+        functions += "};\n";
+        functions += format(
+            "chip8_block_result block_%03X(chip8_state& s, const chip8_host&%s) "
+            "{\n"
+            "  uint16_t flags = 0;\n",
+            start, context.uses_host ? " host" : "");
+        functions += body;
+        functions += format("  s.opcode = 0x%04X;\n", last);
+        if (!ended)
+          functions += format("  s.PC = 0x%03X;\n", address);
+        functions += format("  return {%u, flags};\n}\n", context.count);
+        blocks.push_back({start, address, context.count});
+      }
+      if (!ended && address < b.end)
+        address += 2;  // left to the interpreter
+    }
+  }
+
+  std::string out = format(
+      "// Generated by chip8-recompile from %s, do not edit.\n"
+      "#include <cstring>\n"
+      "#include \"plugin_abi.h\"\n"
+      "\nnamespace {\n",
+      argv[1]);
+  out += functions;
+  out += "\nconst chip8_block blocks[] = {\n";
+  for (const generated_block& b : blocks)
+    out += format("    {0x%03X, 0x%03X, %u, bytes_%03X, block_%03X},\n",
+                  b.start, b.end, b.instructions, b.start, b.start);
+  if (blocks.empty())
+    out += "    {0, 0, 0, nullptr, nullptr},\n";
+  out += "};\n";
+  out += format(
+      "const chip8_plugin plugin = {chip8_plugin_version, 0x%016llXull, "
+      "%zu, %zu, blocks};\n"
+      "\n}  // namespace\n\n"
+      "CHIP8_PLUGIN_EXPORT const chip8_plugin* chip8_plugin_entry() {\n"
+      "  return &plugin;\n"
+      "}\n",
+      static_cast<unsigned long long>(analysis.hash), rom.size(),
+      blocks.size());
+
+  std::ofstream output(argv[2]);
+  output << out;
+  if (!output) {
+    std::fprintf(stderr, "%s: could not write\n", argv[2]);
+    return 1;
+  }
+  std::printf("%s: %zu blocks compiled, %u self-modifying left to the "
+              "interpreter\n",
+              argv[1], blocks.size(), skipped);
+  return 0;
+}
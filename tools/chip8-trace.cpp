@@ -0,0 +1,105 @@
+//Decodes and filters execution traces written by the emulator (CHIP8_TRACE).
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "trace.h"
+
+namespace {
+
+void usage(const char* program) {
+  std::fprintf(stderr,
+               "usage: %s trace.bin [options]\n"
+               "  --pc ADDR            only instructions at ADDR\n"
+               "  --opcode VALUE[/MASK] only opcodes where (op & MASK) == VALUE\n"
+               "  --reg X              only instructions writing VX\n"
+               "  --from CYCLE         skip records before CYCLE\n"
+               "  --to CYCLE           stop after CYCLE\n"
+               "  --stats              print an opcode histogram instead\n",
+               program);
+}
+
+unsigned long long number(const char* text) {
+  return std::strtoull(text, nullptr, 0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  long pc = -1;
+  unsigned op_value = 0;
+  unsigned op_mask = 0;
+  int reg = -1;
+  unsigned long long from = 0;
+  unsigned long long to = ~0ULL;
+  bool stats = false;
+  for (int a = 2; a < argc; ++a) {
+    const bool has_value = a + 1 < argc;
+    if (!std::strcmp(argv[a], "--pc") && has_value) {
+      pc = static_cast<long>(number(argv[++a]));
+    } else if (!std::strcmp(argv[a], "--opcode") && has_value) {
+      const std::string spec = argv[++a];
+      const auto slash = spec.find('/');
+      op_value = static_cast<unsigned>(number(spec.substr(0, slash).c_str()));
+      op_mask = slash == std::string::npos
+                    ? 0xFFFF
+                    : static_cast<unsigned>(
+                          number(spec.substr(slash + 1).c_str()));
+    } else if (!std::strcmp(argv[a], "--reg") && has_value) {
+      reg = static_cast<int>(std::strtol(argv[++a], nullptr, 16));
+    } else if (!std::strcmp(argv[a], "--from") && has_value) {
+      from = number(argv[++a]);
+    } else if (!std::strcmp(argv[a], "--to") && has_value) {
+      to = number(argv[++a]);
+    } else if (!std::strcmp(argv[a], "--stats")) {
+      stats = true;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<trace_record> records;
+  uint64_t total = 0;
+  if (!trace_recorder::load(argv[1], records, total)) {
+    std::fprintf(stderr, "%s: not a CHIP8 trace file\n", argv[1]);
+    return 1;
+  }
+
+  std::vector<unsigned long long> histogram(16);
+  std::size_t matched = 0;
+  for (const auto& r : records) {
+    if (r.cycle < from)
+      continue;
+    if (r.cycle > to)
+      break;
+    if ((pc >= 0 && r.pc != pc) || (r.opcode & op_mask) != op_value ||
+        (reg >= 0 && r.reg != reg))
+      continue;
+    ++matched;
+    if (stats) {
+      ++histogram[r.opcode >> 12];
+      continue;
+    }
+    std::printf("%12llu  %03X  %04X  I=%03X", (unsigned long long)r.cycle,
+                r.pc, r.opcode, r.i);
+    if (r.reg != trace_no_reg)
+      std::printf("  V%X=%02X", r.reg, r.value);
+    std::printf("\n");
+  }
+
+  if (stats) {
+    for (int group = 0; group < 16; ++group) {
+      if (histogram[group])
+        std::printf("%Xxxx  %12llu\n", group, histogram[group]);
+    }
+  }
+  std::fprintf(stderr, "%zu of %zu records matched (%llu executed)\n",
+               matched, records.size(), (unsigned long long)total);
+  return 0;
+}
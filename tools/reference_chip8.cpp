@@ -0,0 +1,198 @@
+#include "reference_chip8.h"
+
+namespace {
+
+unsigned char& mem(chip8_state& s, unsigned address) {
+  return s.memory[address & 0xFFF];
+}
+
+void skip_if(chip8_state& s, bool condition) {
+  s.PC += condition ? 4 : 2;
+}
+
+}  // namespace
+
+void reference_tick_timers(chip8_state& s) {
+  if (s.delay_timer > 0)
+    --s.delay_timer;
+  if (s.sound_timer > 0)
+    --s.sound_timer;
+}
+
+void reference_step(chip8_state& s, unsigned char random) {
+  const unsigned op = mem(s, s.PC) << 8 | mem(s, s.PC + 1);
+  s.opcode = static_cast<unsigned short>(op);
+  const unsigned x = (op >> 8) & 0xF;
+  const unsigned y = (op >> 4) & 0xF;
+  const unsigned n = op & 0xF;
+  const unsigned nn = op & 0xFF;
+  const unsigned nnn = op & 0xFFF;
+  unsigned char& vx = s.V[x];
+  const unsigned char vy = s.V[y];
+
+  switch (op >> 12) {
+    case 0x0:
+      if (op == 0x00E0) {
+        for (auto& pixel : s.gfx)
+          pixel = 0;
+        s.PC += 2;
+      } else if (op == 0x00EE) {
+        s.sp = (s.sp - 1) & 0xF;
+        s.PC = s.stack[s.sp] + 2;
+      }
+      break;  // anything else is unknown and doesn't advance
+    case 0x1:
+      s.PC = nnn;
+      break;
+    case 0x2:
+      s.stack[s.sp & 0xF] = s.PC;
+      s.sp = (s.sp + 1) & 0xF;
+      s.PC = nnn;
+      break;
+    case 0x3:
+      skip_if(s, vx == nn);
+      break;
+    case 0x4:
+      skip_if(s, vx != nn);
+      break;
+    case 0x5:
+      skip_if(s, vx == vy);
+      break;
+    case 0x6:
+      vx = nn;
+      s.PC += 2;
+      break;
+    case 0x7:
+      vx = (vx + nn) & 0xFF;
+      s.PC += 2;
+      break;
+    case 0x8: {
+      unsigned result;
+      int flag = -1;  // -1: VF untouched
+      switch (n) {
+        case 0x0: result = vy; break;
+        case 0x1: result = vx | vy; break;
+        case 0x2: result = vx & vy; break;
+        case 0x3: result = vx ^ vy; break;
+        case 0x4:
+          result = vx + vy;
+          flag = result > 0xFF;
+          break;
+        case 0x5:
+          result = vx - vy;
+          flag = vx >= vy;
+          break;
+        case 0x6:
+          result = vx >> 1;
+          flag = vx & 1;
+          break;
+        case 0x7:
+          result = vy - vx;
+          flag = vy >= vx;
+          break;
+        case 0xE:
+          result = vx << 1;
+          flag = vx >> 7;
+          break;
+        default:
+          return;  // unknown, doesn't advance
+      }
+      vx = result & 0xFF;
+      if (flag >= 0)
+        s.V[0xF] = static_cast<unsigned char>(flag);
+      s.PC += 2;
+    } break;
+    case 0x9:
+      skip_if(s, vx != vy);
+      break;
+    case 0xA:
+      s.I = nnn;
+      s.PC += 2;
+      break;
+    case 0xB:
+      s.PC = nnn + s.V[0];
+      break;
+    case 0xC:
+      vx = random & nn;
+      s.PC += 2;
+      break;
+    case 0xD: {
+      const unsigned x0 = vx % 64;
+      const unsigned y0 = vy % 32;
+      s.V[0xF] = 0;
+      for (unsigned row = 0; row < n; ++row) {
+        const unsigned char bits = mem(s, s.I + row);
+        for (unsigned col = 0; col < 8; ++col) {
+          if (!(bits & (0x80 >> col)))
+            continue;
+          unsigned char& pixel =
+              s.gfx[(x0 + col) % 64 + ((y0 + row) % 32) * 64];
+          if (pixel)
+            s.V[0xF] = 1;
+          pixel ^= 1;
+        }
+      }
+      s.PC += 2;
+    } break;
+    case 0xE:
+      if (nn == 0x9E)
+        skip_if(s, s.key[vx & 0xF] == 1);
+      else if (nn == 0xA1)
+        skip_if(s, s.key[vx & 0xF] == 0);
+      break;
+    case 0xF:
+      switch (nn) {
+        case 0x07:
+          vx = s.delay_timer;
+          break;
+        case 0x0A:
+          if (!s.key_wait) {
+            s.key_wait = true;
+            s.key_released = 0;
+          }
+          if (!s.key_released)
+            return;
+          for (unsigned k = 0; k < 16; ++k) {
+            if (s.key_released & (1 << k)) {
+              vx = static_cast<unsigned char>(k);
+              break;
+            }
+          }
+          s.key_wait = false;
+          break;
+        case 0x15:
+          s.delay_timer = vx;
+          break;
+        case 0x18:
+          s.sound_timer = vx;
+          break;
+        case 0x1E: {
+          const bool overflow = s.I + vx > 0xFFF;
+          s.I += vx;
+          s.V[0xF] = overflow;
+        } break;
+        case 0x29:
+          s.I = vx * 5;
+          break;
+        case 0x33:
+          mem(s, s.I) = vx / 100;
+          mem(s, s.I + 1) = vx / 10 % 10;
+          mem(s, s.I + 2) = vx % 10;
+          break;
+        case 0x55:
+          for (unsigned i = 0; i <= x; ++i)
+            mem(s, s.I + i) = s.V[i];
+          s.I += x + 1;
+          break;
+        case 0x65:
+          for (unsigned i = 0; i <= x; ++i)
+            s.V[i] = mem(s, s.I + i);
+          s.I += x + 1;
+          break;
+        default:
+          return;  // unknown, doesn't advance
+      }
+      s.PC += 2;
+      break;
+  }
+}
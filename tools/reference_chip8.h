@@ -0,0 +1,18 @@
+#ifndef REFERENCE_CHIP8_H
+#define REFERENCE_CHIP8_H
+
+#include "chip8.h"
+
+//Straightforward model of the instruction set, written from the spec rather
+//than from chip8.cpp so the two can be checked against each other. It runs
+//on the same chip8_state and follows the quirks the interpreter chose:
+//  - 8XY6/8XYE shift VX in place, VF is written after the result
+//  - FX55/FX65 advance I by X + 1, FX1E sets VF on overflow past 0xFFF
+//  - DXYN wraps the sprite around both screen edges
+//  - every memory and stack access wraps (& 0xFFF, & 0xF)
+//The random byte for CXNN is passed in so both sides can agree on it.
+void reference_step(chip8_state& s, unsigned char random);
+//Once per 60 Hz frame
+void reference_tick_timers(chip8_state& s);
+
+#endif